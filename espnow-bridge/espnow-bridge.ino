@@ -0,0 +1,233 @@
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+
+// Bridge settings, the channel and rate must match the gloves.
+#define SERIAL_BAUD_RATE 115200
+#define ESPNOW_CHANNEL   1
+#define ESPNOW_PHY_RATE  WIFI_PHY_RATE_24M
+#define TAG_HANDS        false // Prefix lines with (HL) or (HR) so one port can carry both gloves.
+
+#define HAND_COUNT        2
+#define MAX_PACKET        250
+#define RX_QUEUE          16
+#define LINE_BUFFER       512
+#define SERIAL_BUFFER     256
+
+// Packets are a header followed by text, this must match ESPNowCommunication.hpp:
+//   uint8_t  magic     'G'
+//   uint8_t  hand      0 = left, 1 = right
+//   uint16_t sequence  Incremented for every packet, gaps mean lost packets.
+//   char     text[]
+struct Header {
+  uint8_t magic;
+  uint8_t hand;
+  uint16_t sequence;
+};
+#define MAGIC 'G'
+#define MAX_TEXT (MAX_PACKET - sizeof(Header))
+
+const char* HAND_TAGS[HAND_COUNT] = {"(HL)", "(HR)"};
+
+struct Hand {
+  bool known;
+  uint8_t address[ESP_NOW_ETH_ALEN];
+  bool receiving;
+  uint16_t last_received;
+  uint16_t sequence;
+  uint32_t lost_packets;
+  uint32_t failed_sends;
+  char line[LINE_BUFFER];
+  size_t line_length;
+};
+
+Hand hands[HAND_COUNT];
+
+// Single producer (WiFi task) single consumer (loop) queue of received packets.
+struct Packet {
+  uint8_t address[ESP_NOW_ETH_ALEN];
+  uint8_t length;
+  uint8_t data[MAX_PACKET];
+};
+volatile Packet rx_queue[RX_QUEUE];
+volatile uint8_t rx_head = 0;
+volatile uint8_t rx_tail = 0;
+volatile uint32_t rx_overflows = 0;
+
+char serial_line[SERIAL_BUFFER];
+size_t serial_length = 0;
+
+void receive(const uint8_t* address, const uint8_t* data, int length) {
+  if (length < (int)sizeof(Header) || length > MAX_PACKET) return;
+  uint8_t next = (rx_head + 1) % RX_QUEUE;
+  if (next == rx_tail) {
+    rx_overflows++;
+    return;
+  }
+  memcpy((uint8_t*)rx_queue[rx_head].address, address, ESP_NOW_ETH_ALEN);
+  memcpy((uint8_t*)rx_queue[rx_head].data, data, length);
+  rx_queue[rx_head].length = length;
+  rx_head = next;
+}
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+  void onReceive(const esp_now_recv_info_t* info, const uint8_t* data, int length) {
+    receive(info->src_addr, data, length);
+  }
+#else
+  void onReceive(const uint8_t* address, const uint8_t* data, int length) {
+    receive(address, data, length);
+  }
+#endif
+
+void onSent(const uint8_t* address, esp_now_send_status_t status) {
+  if (status == ESP_NOW_SEND_SUCCESS) return;
+  for (int i = 0; i < HAND_COUNT; i++) {
+    if (hands[i].known && memcmp(hands[i].address, address, ESP_NOW_ETH_ALEN) == 0) {
+      hands[i].failed_sends++;
+    }
+  }
+}
+
+// Send text to a glove, an empty text only tells the glove where the bridge is.
+void sendToHand(int index, const char* text, size_t length) {
+  Hand& hand = hands[index];
+  if (!hand.known) return;
+
+  uint8_t packet[MAX_PACKET];
+  Header header = {MAGIC, (uint8_t)index, hand.sequence++};
+  length = min(length, MAX_TEXT);
+  memcpy(packet, &header, sizeof(Header));
+  memcpy(packet + sizeof(Header), text, length);
+  if (esp_now_send(hand.address, packet, sizeof(Header) + length) != ESP_OK) hand.failed_sends++;
+}
+
+void addHand(int index, const uint8_t* address) {
+  Hand& hand = hands[index];
+  if (hand.known) esp_now_del_peer(hand.address);
+
+  esp_now_peer_info_t info = {};
+  memcpy(info.peer_addr, address, ESP_NOW_ETH_ALEN);
+  info.channel = ESPNOW_CHANNEL;
+  info.ifidx = WIFI_IF_STA;
+  info.encrypt = false;
+  esp_now_add_peer(&info);
+
+  memcpy(hand.address, address, ESP_NOW_ETH_ALEN);
+  hand.known = true;
+  sendToHand(index, "", 0);
+}
+
+// Forward the text of a glove's packet, only whole lines are written so the
+// two gloves never interleave within a line.
+void handlePacket(const uint8_t* address, const uint8_t* data, size_t length) {
+  Header header;
+  memcpy(&header, data, sizeof(Header));
+  if (header.magic != MAGIC || header.hand >= HAND_COUNT) return;
+
+  Hand& hand = hands[header.hand];
+  if (!hand.known || memcmp(hand.address, address, ESP_NOW_ETH_ALEN) != 0) {
+    addHand(header.hand, address);
+    hand.receiving = false;
+  }
+
+  // A lost packet may have held part of the current line, drop it.
+  if (hand.receiving && header.sequence != (uint16_t)(hand.last_received + 1)) {
+    hand.lost_packets += (uint16_t)(header.sequence - hand.last_received - 1);
+    hand.line_length = 0;
+  }
+  hand.last_received = header.sequence;
+  hand.receiving = true;
+
+  for (size_t i = sizeof(Header); i < length; i++) {
+    if (hand.line_length < LINE_BUFFER - 1) hand.line[hand.line_length++] = data[i];
+    if (data[i] != '\n') continue;
+
+    if (TAG_HANDS) Serial.write(HAND_TAGS[header.hand], 4);
+    Serial.write((const uint8_t*)hand.line, hand.line_length);
+    hand.line_length = 0;
+  }
+}
+
+// A host line that doesn't fit in one packet is dropped and reported, the
+// gloves take one line per packet.
+void rejectLine(size_t length) {
+  char report[32];
+  snprintf(report, sizeof(report), "(NE)%lu\n", (unsigned long)length);
+  Serial.print(report);
+}
+
+// Commands from the host. Lines tagged (HL) or (HR) go to that glove, untagged
+// lines go to every glove. (NS) reports the link statistics.
+void handleSerialLine(char* line, size_t length) {
+  if (strncmp(line, "(NS)", 4) == 0) {
+    char report[128];
+    snprintf(report, sizeof(report), "(NL)%lu,%lu(NR)%lu,%lu(NQ)%lu\n",
+             (unsigned long)hands[0].lost_packets, (unsigned long)hands[0].failed_sends,
+             (unsigned long)hands[1].lost_packets, (unsigned long)hands[1].failed_sends,
+             (unsigned long)rx_overflows);
+    Serial.print(report);
+    return;
+  }
+
+  for (int i = 0; i < HAND_COUNT; i++) {
+    if (strncmp(line, HAND_TAGS[i], 4) == 0) {
+      if (length - 4 > MAX_TEXT) rejectLine(length);
+      else sendToHand(i, line + 4, length - 4);
+      return;
+    }
+  }
+
+  if (length > MAX_TEXT) {
+    rejectLine(length);
+    return;
+  }
+  for (int i = 0; i < HAND_COUNT; i++) {
+    sendToHand(i, line, length);
+  }
+}
+
+void setup() {
+  Serial.begin(SERIAL_BAUD_RATE);
+
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+  esp_wifi_set_channel(ESPNOW_CHANNEL, WIFI_SECOND_CHAN_NONE);
+  esp_wifi_set_ps(WIFI_PS_NONE);
+
+  if (esp_now_init() != ESP_OK) {
+    Serial.println("ESP-NOW failed to start!");
+    return;
+  }
+  esp_now_register_recv_cb(onReceive);
+  esp_now_register_send_cb(onSent);
+  esp_wifi_config_espnow_rate(WIFI_IF_STA, ESPNOW_PHY_RATE);
+
+  Serial.print("Bridge started, its address is ");
+  Serial.println(WiFi.macAddress());
+}
+
+void loop() {
+  while (rx_tail != rx_head) {
+    volatile Packet& packet = rx_queue[rx_tail];
+    handlePacket((const uint8_t*)packet.address, (const uint8_t*)packet.data, packet.length);
+    rx_tail = (rx_tail + 1) % RX_QUEUE;
+  }
+
+  while (Serial.available() > 0) {
+    // Keep counting past the end of the buffer so long lines are rejected
+    // instead of cut off.
+    char c = Serial.read();
+    if (serial_length < SERIAL_BUFFER - 1) serial_line[serial_length] = c;
+    serial_length++;
+    if (c != '\n') continue;
+
+    if (serial_length < SERIAL_BUFFER) {
+      serial_line[serial_length] = '\0';
+      handleSerialLine(serial_line, serial_length);
+    } else {
+      rejectLine(serial_length);
+    }
+    serial_length = 0;
+  }
+}
@@ -0,0 +1,274 @@
+// Benchmarks the fixed point Mahony filter (IMU.hpp) against the same filter
+// in floating point. Prints the time per update and how far apart the filters
+// are, on either:
+//  * an IMU capture recorded with hw-test (See hw-test/README.md). While the
+//    hand is still the accelerometer measures gravity, the error is the angle
+//    between it and the gravity each filter estimates.
+//  * a simulated hand that keeps rotating, the error is how far each filter
+//    ends up from the true orientation.
+//
+//   ./imu_bench imu.bin              or        ./imu_bench [seconds of motion]
+//
+// Uses the IMU settings in open-gloves/Config.h. The time is the PC's, on the
+// ESP32 the fixed point filter is much further ahead since it has no fast
+// doubles.
+
+#include "Arduino.h"
+
+#include "../open-gloves/Config.h"
+#include "../open-gloves/IMU.hpp"
+
+#include <chrono>
+#include <vector>
+
+static constexpr double ACCEL_LSB_PER_G = 8192; // +-4g
+
+struct Sample {
+  int16_t gyro[3];
+  int16_t accel[3];
+};
+
+// q += q * (0, h) with the half rotation h, then normalized.
+static void rotate(double q[4], const double h[3]) {
+  double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  q[0] += -q1 * h[0] - q2 * h[1] - q3 * h[2];
+  q[1] +=  q0 * h[0] + q2 * h[2] - q3 * h[1];
+  q[2] +=  q0 * h[1] - q1 * h[2] + q3 * h[0];
+  q[3] +=  q0 * h[2] + q1 * h[1] - q2 * h[0];
+  double norm = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  for (int i = 0; i < 4; i++) q[i] /= norm;
+}
+
+// Direction of gravity in the sensor's frame.
+static void gravity(const double q[4], double v[3]) {
+  v[0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+  v[1] = 2 * (q[0] * q[1] + q[2] * q[3]);
+  v[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+}
+
+// The reference, the same steps as MahonyFilter in doubles.
+class FloatMahony {
+ public:
+  void update(const int16_t gyro[3], const int16_t accel[3]) {
+    double h[3];
+    for (int i = 0; i < 3; i++) {
+      h[i] = gyro[i] / IMU_GYRO_LSB_PER_DPS * (M_PI / 180) * 0.5 / IMU_SAMPLE_RATE;
+    }
+
+    double norm = sqrt((double)accel[0] * accel[0] + (double)accel[1] * accel[1] + (double)accel[2] * accel[2]);
+    if (norm > 0) {
+      double v[3];
+      gravity(q, v);
+      double a[3] = {accel[0] / norm, accel[1] / norm, accel[2] / norm};
+      double e[3] = {a[1] * v[2] - a[2] * v[1], a[2] * v[0] - a[0] * v[2], a[0] * v[1] - a[1] * v[0]};
+      for (int i = 0; i < 3; i++) {
+        integral[i] += e[i] * IMU_MAHONY_KI * 0.5 / IMU_SAMPLE_RATE / IMU_SAMPLE_RATE;
+        h[i] += integral[i] + e[i] * IMU_MAHONY_KP * 0.5 / IMU_SAMPLE_RATE;
+      }
+    }
+    rotate(q, h);
+  }
+
+  double q[4] = {1, 0, 0, 0};
+  double integral[3] = {0, 0, 0};
+};
+
+// Angle between two orientations in degrees.
+static double angle(const double a[4], const double b[4]) {
+  double dot = fabs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+  return 2 * acos(std::min(dot, 1.0)) * 180 / M_PI;
+}
+
+// Keeps the timed filters from being optimized away.
+static int32_t firstComponent(const MahonyFilter& filter) {
+  return filter.getQuaternion()[0];
+}
+
+static int32_t firstComponent(const FloatMahony& filter) {
+  return filter.q[0] * MahonyFilter::ONE;
+}
+
+// Runs the filter over the samples for about half a second.
+template<typename Filter>
+static double nanosPerUpdate(const std::vector<Sample>& samples, int32_t& checksum) {
+  auto start = std::chrono::steady_clock::now();
+  int runs = 0;
+  do {
+    Filter filter;
+    for (const Sample& sample : samples) filter.update(sample.gyro, sample.accel);
+    checksum += firstComponent(filter);
+    runs++;
+  } while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / runs / samples.size();
+}
+
+// Reads the blocks with 6 channels from an hw-test capture. Lost blocks are
+// counted, the filters just carry on across them.
+static bool readCapture(const char* path, std::vector<Sample>& samples, int& lost) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return false;
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + read);
+  fclose(file);
+
+  // The header, little endian: "OG", channels, sweeps, block, start us, end us.
+  const size_t HEADER_SIZE = 16;
+  lost = 0;
+  long last_block = -1;
+  for (size_t offset = 0; offset + HEADER_SIZE <= data.size(); offset++) {
+    if (data[offset] != 'O' || data[offset + 1] != 'G') continue;
+    int channels = data[offset + 2], sweeps = data[offset + 3];
+    uint32_t block = data[offset + 4] | data[offset + 5] << 8 | data[offset + 6] << 16 | (uint32_t)data[offset + 7] << 24;
+    size_t end = offset + HEADER_SIZE + channels * sweeps * 2;
+    if (channels != 6 || sweeps == 0 || end > data.size()) continue;
+
+    if (last_block >= 0 && block > (uint32_t)last_block) lost += block - last_block - 1;
+    last_block = block;
+    const uint8_t* values = &data[offset + HEADER_SIZE];
+    for (int sweep = 0; sweep < sweeps; sweep++, values += 12) {
+      Sample sample;
+      for (int i = 0; i < 3; i++) {
+        sample.accel[i] = (int16_t)(values[i * 2] | values[i * 2 + 1] << 8);
+        sample.gyro[i] = (int16_t)(values[6 + i * 2] | values[6 + i * 2 + 1] << 8);
+      }
+      samples.push_back(sample);
+    }
+    offset = end - 1;
+  }
+  return true;
+}
+
+// Still enough that the accelerometer only measures gravity.
+static bool isStill(const Sample& sample) {
+  double norm = sqrt((double)sample.accel[0] * sample.accel[0] + (double)sample.accel[1] * sample.accel[1] +
+                     (double)sample.accel[2] * sample.accel[2]) / ACCEL_LSB_PER_G;
+  if (fabs(norm - 1) > 0.05) return false;
+  for (int i = 0; i < 3; i++) {
+    if (fabs(sample.gyro[i] / IMU_GYRO_LSB_PER_DPS) > 10) return false;
+  }
+  return true;
+}
+
+// Angle between the measured and the estimated gravity in degrees.
+static double tiltError(const double q[4], const Sample& sample) {
+  double v[3];
+  gravity(q, v);
+  double norm = sqrt((double)sample.accel[0] * sample.accel[0] + (double)sample.accel[1] * sample.accel[1] +
+                     (double)sample.accel[2] * sample.accel[2]);
+  double dot = (sample.accel[0] * v[0] + sample.accel[1] * v[1] + sample.accel[2] * v[2]) / norm;
+  return acos(std::max(-1.0, std::min(dot, 1.0))) * 180 / M_PI;
+}
+
+static void fixedQuaternion(const MahonyFilter& filter, double q[4]) {
+  for (int i = 0; i < 4; i++) q[i] = (double)filter.getQuaternion()[i] / MahonyFilter::ONE;
+}
+
+// Runs a capture through both filters, sample by sample.
+static void benchCapture(const std::vector<Sample>& samples, int lost) {
+  // The filters need a moment to find gravity from the start orientation.
+  const size_t SETTLE_SAMPLES = 2 * IMU_SAMPLE_RATE;
+
+  MahonyFilter fixed;
+  FloatMahony reference;
+  double apart_max = 0, apart_sum = 0;
+  double fixed_tilt_max = 0, fixed_tilt_sum = 0, float_tilt_max = 0, float_tilt_sum = 0;
+  long still = 0;
+  for (size_t n = 0; n < samples.size(); n++) {
+    fixed.update(samples[n].gyro, samples[n].accel);
+    reference.update(samples[n].gyro, samples[n].accel);
+    double fixed_q[4];
+    fixedQuaternion(fixed, fixed_q);
+
+    double apart = angle(fixed_q, reference.q);
+    apart_max = std::max(apart_max, apart);
+    apart_sum += apart;
+
+    if (n < SETTLE_SAMPLES || !isStill(samples[n])) continue;
+    double fixed_tilt = tiltError(fixed_q, samples[n]), float_tilt = tiltError(reference.q, samples[n]);
+    fixed_tilt_max = std::max(fixed_tilt_max, fixed_tilt);
+    fixed_tilt_sum += fixed_tilt;
+    float_tilt_max = std::max(float_tilt_max, float_tilt);
+    float_tilt_sum += float_tilt;
+    still++;
+  }
+
+  int32_t checksum = 0;
+  double fixed_ns = nanosPerUpdate<MahonyFilter>(samples, checksum);
+  double float_ns = nanosPerUpdate<FloatMahony>(samples, checksum);
+
+  printf("%ld recorded samples at %dHz, %d blocks lost, %ld still (checksum %ld)\n",
+         (long)samples.size(), IMU_SAMPLE_RATE, lost, still, (long)checksum);
+  if (still > 0) {
+    printf("fixed point: %6.1f ns/update, tilt from gravity while still %6.3f mean %6.3f max degrees\n",
+           fixed_ns, fixed_tilt_sum / still, fixed_tilt_max);
+    printf("float:       %6.1f ns/update, tilt from gravity while still %6.3f mean %6.3f max degrees\n",
+           float_ns, float_tilt_sum / still, float_tilt_max);
+  } else {
+    printf("fixed point: %6.1f ns/update\n", fixed_ns);
+    printf("float:       %6.1f ns/update\n", float_ns);
+    printf("The hand was never still, there is no gravity to compare against.\n");
+  }
+  printf("fixed point is %.3f mean %.3f max degrees from float\n", apart_sum / samples.size(), apart_max);
+}
+
+int main(int argc, char* argv[]) {
+  char* end = nullptr;
+  double seconds = argc > 1 ? strtod(argv[1], &end) : 10;
+  if (argc > 1 && *end != '\0') {
+    std::vector<Sample> samples;
+    int lost;
+    if (!readCapture(argv[1], samples, lost)) {
+      fprintf(stderr, "Can't open %s\n", argv[1]);
+      return 1;
+    }
+    if (samples.empty()) {
+      fprintf(stderr, "No IMU capture blocks in %s\n", argv[1]);
+      return 1;
+    }
+    benchCapture(samples, lost);
+    return 0;
+  }
+
+  // The hand turns on all axes at up to a few hundred degrees per second.
+  std::vector<Sample> samples;
+  double truth[4] = {1, 0, 0, 0};
+  for (long n = 0; n < seconds * IMU_SAMPLE_RATE; n++) {
+    double t = (double)n / IMU_SAMPLE_RATE;
+    double rates[3] = {200 * sin(t * 1.3), 150 * sin(t * 0.7 + 1), 300 * sin(t * 0.5 + 2)};
+
+    Sample sample;
+    double v[3];
+    gravity(truth, v);
+    for (int i = 0; i < 3; i++) {
+      sample.gyro[i] = constrain(lround(rates[i] * IMU_GYRO_LSB_PER_DPS), -32768, 32767);
+      sample.accel[i] = lround(v[i] * ACCEL_LSB_PER_G);
+    }
+    samples.push_back(sample);
+
+    double h[3];
+    for (int i = 0; i < 3; i++) h[i] = sample.gyro[i] / IMU_GYRO_LSB_PER_DPS * (M_PI / 180) * 0.5 / IMU_SAMPLE_RATE;
+    rotate(truth, h);
+  }
+
+  MahonyFilter fixed;
+  FloatMahony reference;
+  for (const Sample& sample : samples) {
+    fixed.update(sample.gyro, sample.accel);
+    reference.update(sample.gyro, sample.accel);
+  }
+  double fixed_q[4];
+  fixedQuaternion(fixed, fixed_q);
+
+  int32_t checksum = 0;
+  double fixed_ns = nanosPerUpdate<MahonyFilter>(samples, checksum);
+  double float_ns = nanosPerUpdate<FloatMahony>(samples, checksum);
+
+  printf("%ld samples at %dHz (checksum %ld)\n", (long)samples.size(), IMU_SAMPLE_RATE, (long)checksum);
+  printf("fixed point: %6.1f ns/update, %6.3f degrees from the truth\n", fixed_ns, angle(fixed_q, truth));
+  printf("float:       %6.1f ns/update, %6.3f degrees from the truth\n", float_ns, angle(reference.q, truth));
+  printf("fixed point is %.3f degrees from float\n", angle(fixed_q, reference.q));
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Runs a recording dumped with (RD) through the firmware on a PC, and prints
+// the frames it would have sent. The firmware is built with the settings in
+// open-gloves/Config.h, so it calibrates and detects gestures the same way the
+// glove does.
+//
+//   ./replay dump.txt        or        ./replay < dump.txt
+//
+// The dump must come from a glove with the same inputs enabled, the values are
+// handed to the inputs in the order they were recorded.
+
+#include "Arduino.h"
+
+// Replays always go through the flash ring, and the recorded values are
+// already corrected.
+#include "../open-gloves/Config.h"
+#undef ENABLE_RECORDING
+#define ENABLE_RECORDING true
+#undef RECORD_SINK
+#define RECORD_SINK RECORD_SINK_FLASH
+#undef ENABLE_ADC_CORRECTION
+#define ENABLE_ADC_CORRECTION false
+#undef ENABLE_RUNTIME_SETTINGS
+#define ENABLE_RUNTIME_SETTINGS false
+#undef COMMUNICATION
+#define COMMUNICATION COMM_USB
+
+#include "../open-gloves/open-gloves.ino"
+
+#include <vector>
+
+struct Record {
+  unsigned long time;
+  std::vector<int> values;
+};
+
+// Parse the "(RD)<time>:<value>,<value>,...", lines, everything else is skipped.
+static std::vector<Record> readDump(FILE* input) {
+  std::vector<Record> records;
+  char line[4096];
+  while (fgets(line, sizeof(line), input)) {
+    if (strncmp(line, "(RD)", 4) != 0 || strncmp(line, "(RD)END", 7) == 0) continue;
+    Record record;
+    char* cursor = line + 4;
+    record.time = strtoul(cursor, &cursor, 10);
+    if (*cursor != ':') continue;
+    while (*cursor == ':' || *cursor == ',') {
+      record.values.push_back(strtol(cursor + 1, &cursor, 10));
+    }
+    records.push_back(record);
+  }
+  return records;
+}
+
+// Store the records in the flash ring the same way the glove recorded them.
+static void import(const std::vector<Record>& records) {
+  SampleTrace::handle(nullptr, "(RS)");
+  unsigned long start = micros();
+  for (const Record& record : records) {
+    host::now_us = start + record.time;
+    SampleTrace::beginFrame(micros());
+    for (int value : record.values) {
+      host::analog_values.push_back(value);
+      SampleTrace::analog(0);
+    }
+    SampleTrace::endFrame(nullptr);
+  }
+  SampleTrace::handle(nullptr, "(RE)");
+}
+
+int main(int argc, char** argv) {
+  FILE* input = argc > 1 ? fopen(argv[1], "r") : stdin;
+  if (input == nullptr) {
+    fprintf(stderr, "Can't open %s\n", argv[1]);
+    return 1;
+  }
+  std::vector<Record> records = readDump(input);
+  if (records.empty()) {
+    fprintf(stderr, "No (RD) records found\n");
+    return 1;
+  }
+
+  setup();
+  import(records);
+
+  // Replay until the firmware goes back to the live sensors.
+  host::serial_input.push_back("(RP)");
+  loop();
+  while (SampleTrace::getMode() == SampleTrace::REPLAYING) {
+    loop();
+  }
+  return 0;
+}
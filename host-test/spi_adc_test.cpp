@@ -0,0 +1,132 @@
+// Tests the external SPI ADC driver (SPIADC.hpp) against simulated MCP3208 and
+// ADS8688 chips. Built once for each with TEST_EXTERNAL_ADC set.
+
+#include "Arduino.h"
+#include "driver/spi_master.h"
+
+#include "../open-gloves/Config.h"
+#undef EXTERNAL_ADC
+#define EXTERNAL_ADC TEST_EXTERNAL_ADC
+#undef ENABLE_ADC_CORRECTION
+#define ENABLE_ADC_CORRECTION false
+// Config.h picks the range before the ADC is overridden here.
+#undef ANALOG_MAX
+#if EXTERNAL_ADC == EXTERNAL_ADC_ADS8688
+  #define ANALOG_MAX 32767
+#else
+  #define ANALOG_MAX BUILTIN_ANALOG_MAX
+#endif
+
+#include "../open-gloves/AnalogSource.hpp"
+
+static int failures = 0;
+
+#define CHECK_EQUAL(actual, expected) do { \
+    long actual_value = (actual), expected_value = (expected); \
+    if (actual_value != expected_value) { \
+      printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, actual_value, expected_value); \
+      failures++; \
+    } \
+  } while (0)
+
+// What each channel of the simulated chip reads.
+static uint16_t inputs[8];
+static int frames = 0;
+
+#if EXTERNAL_ADC == EXTERNAL_ADC_MCP3208
+  static constexpr int BITS = 12;
+
+  // Start bit and single ended mode in the first byte, the result is clocked
+  // out in the low nibble of the second byte and the third byte.
+  static void chip(const uint8_t* tx, uint8_t* rx, size_t size) {
+    frames++;
+    CHECK_EQUAL(size, 3);
+    CHECK_EQUAL(tx[0] & 0xFE, 0x06);
+    int channel = ((tx[0] & 0x01) << 2) | (tx[1] >> 6);
+    rx[0] = 0xFF;
+    rx[1] = 0xE0 | (inputs[channel] >> 8); // The high bits aren't driven.
+    rx[2] = inputs[channel] & 0xFF;
+  }
+#else
+  static constexpr int BITS = 16;
+  static int ranges[8];
+  static int converting = -1;
+  static int selected = 0;
+
+  // Commands are in the first 16 bits, the result of the conversion started by
+  // the previous frame is clocked out in the last 16 bits.
+  static void chip(const uint8_t* tx, uint8_t* rx, size_t size) {
+    frames++;
+    CHECK_EQUAL(size, 4);
+    uint16_t command = (tx[0] << 8) | tx[1];
+    uint16_t result = converting >= 0 ? inputs[converting] : 0;
+    rx[0] = rx[1] = 0;
+    rx[2] = result >> 8;
+    rx[3] = result & 0xFF;
+
+    if (command & 0x0100) {
+      // Program register write, the range registers start at 0x05.
+      int address = command >> 9;
+      if (address >= 0x05 && address < 0x05 + 8) ranges[address - 0x05] = command & 0xFF;
+      converting = -1;
+    } else if ((command & 0xC000) == 0xC000) {
+      selected = (command >> 10) & 0x07;
+      converting = selected;
+    } else {
+      // A no-op keeps converting the selected channel.
+      CHECK_EQUAL(command, 0);
+      converting = selected;
+    }
+  }
+#endif
+
+static int expected(int raw) {
+  return ((uint32_t)raw * (ANALOG_MAX + 1UL)) >> BITS;
+}
+
+int main() {
+  host::spi_device = chip;
+  AnalogSource::setup();
+
+  CHECK_EQUAL(host::spi_dma_channel, SPI_DMA_DISABLED);
+  #if EXTERNAL_ADC == EXTERNAL_ADC_MCP3208
+    CHECK_EQUAL(host::spi_mode, 0);
+  #else
+    CHECK_EQUAL(host::spi_mode, 1);
+    for (int channel = 0; channel < EXTERNAL_ADC_CHANNELS; channel++) {
+      CHECK_EQUAL(ranges[channel], ADS8688_RANGE);
+    }
+  #endif
+
+  // Every channel distinct, including the ends of the range.
+  for (int round = 0; round < 3; round++) {
+    for (int channel = 0; channel < EXTERNAL_ADC_CHANNELS; channel++) {
+      int value = (channel * 4099 + round * 977) % (1 << BITS);
+      if (channel == 0) value = 0;
+      if (channel == 7) value = (1 << BITS) - 1;
+      inputs[channel] = value;
+    }
+
+    frames = 0;
+    host::spi_max_queued = 0;
+    AnalogSource::sample();
+    #if EXTERNAL_ADC == EXTERNAL_ADC_MCP3208
+      CHECK_EQUAL(frames, EXTERNAL_ADC_CHANNELS);
+    #else
+      CHECK_EQUAL(frames, EXTERNAL_ADC_CHANNELS + 1);
+    #endif
+    CHECK_EQUAL(host::spi_max_queued <= host::spi_queue_size, true);
+
+    for (int channel = 0; channel < EXTERNAL_ADC_CHANNELS; channel++) {
+      CHECK_EQUAL(AnalogSource::read(EXTERNAL_ADC_PIN(channel)), expected(inputs[channel]));
+    }
+  }
+  CHECK_EQUAL(AnalogSource::read(EXTERNAL_ADC_PIN(7)), ANALOG_MAX);
+
+  // The built in ADC is scaled to the same range.
+  host::analog_values.push_back(BUILTIN_ANALOG_MAX);
+  CHECK_EQUAL(AnalogSource::read(36), (long)BUILTIN_ANALOG_MAX * (ANALOG_MAX + 1) / (BUILTIN_ANALOG_MAX + 1));
+
+  printf("%s: %s\n", EXTERNAL_ADC == EXTERNAL_ADC_MCP3208 ? "MCP3208" : "ADS8688", failures ? "FAILED" : "passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+// Just enough of the Arduino core to run the firmware on a PC. Time only moves
+// when the firmware waits, so every run of a test is the same.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+#define LED_BUILTIN 2
+#define IRAM_ATTR
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+namespace host {
+  // The virtual clock.
+  inline unsigned long now_us = 0;
+  // analogRead() returns these in order, then 0.
+  inline std::deque<int> analog_values;
+  // Lines the firmware reads from Serial, without the newline.
+  inline std::deque<std::string> serial_input;
+}
+
+inline unsigned long micros() { return host::now_us; }
+inline unsigned long millis() { return host::now_us / 1000; }
+inline void delayMicroseconds(unsigned int us) { host::now_us += us; }
+inline void delay(unsigned long ms) { host::now_us += ms * 1000; }
+inline void yield() {}
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+// Buttons are wired to pull ups, they all read as released.
+inline int digitalRead(int) { return HIGH; }
+inline int analogRead(int) {
+  if (host::analog_values.empty()) return 0;
+  int value = host::analog_values.front();
+  host::analog_values.pop_front();
+  return value;
+}
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterruptArg(int, void (*)(void*), void*, int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Output goes to stdout, input comes from host::serial_input.
+class HardwareSerial {
+ public:
+  void begin(unsigned long) {}
+  void end() {}
+  void setTimeout(unsigned long) {}
+  size_t setTxBufferSize(size_t size) { return size; }
+  void flush() { fflush(stdout); }
+  void updateBaudRate(unsigned long) {}
+  size_t print(const char* text) { return fputs(text, stdout) >= 0 ? strlen(text) : 0; }
+  size_t println(const char* text = "") { return print(text) + print("\n"); }
+  size_t write(const uint8_t* data, size_t size) { return fwrite(data, 1, size, stdout); }
+  int available() { return host::serial_input.empty() ? 0 : host::serial_input.front().size() + 1; }
+  size_t readBytesUntil(char, char* buffer, size_t length) {
+    if (host::serial_input.empty()) return 0;
+    std::string line = host::serial_input.front();
+    host::serial_input.pop_front();
+    size_t size = min(line.size(), length);
+    memcpy(buffer, line.data(), size);
+    return size;
+  }
+  operator bool() const { return true; }
+};
+
+inline HardwareSerial Serial;
@@ -0,0 +1,11 @@
+#pragma once
+
+#define MIN_PULSE_WIDTH 544
+#define MAX_PULSE_WIDTH 2400
+
+class Servo {
+ public:
+  void attach(int) {}
+  void write(int) {}
+  void writeMicroseconds(int) {}
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+// LittleFS on a PC, the files are kept in memory.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class File {
+ public:
+  File() : data(nullptr), position(0) {}
+  explicit File(std::vector<uint8_t>* data) : data(data), position(0) {}
+
+  operator bool() const { return data != nullptr; }
+  void close() { data = nullptr; }
+  size_t size() const { return data->size(); }
+
+  bool seek(uint32_t offset) {
+    position = offset;
+    return true;
+  }
+
+  size_t write(const uint8_t* buffer, size_t length) {
+    if (data->size() < position + length) data->resize(position + length);
+    memcpy(data->data() + position, buffer, length);
+    position += length;
+    return length;
+  }
+
+  size_t read(uint8_t* buffer, size_t length) {
+    size_t available = position < data->size() ? data->size() - position : 0;
+    if (length > available) length = available;
+    memcpy(buffer, data->data() + position, length);
+    position += length;
+    return length;
+  }
+
+ private:
+  std::vector<uint8_t>* data;
+  size_t position;
+};
+
+class LittleFSFS {
+ public:
+  bool begin(bool) { return true; }
+
+  File open(const char* path, const char* mode) {
+    auto file = files.find(path);
+    if (mode[0] == 'w') {
+      files[path].clear();
+    } else if (file == files.end()) {
+      return File();
+    }
+    return File(&files[path]);
+  }
+
+ private:
+  std::map<std::string, std::vector<uint8_t>> files;
+};
+
+inline LittleFSFS LittleFS;
@@ -0,0 +1,90 @@
+#pragma once
+
+// The ESP-IDF SPI master driver on a PC. Every transaction is handed to
+// host::spi_device right away, as if the chip select was pulsed around it.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <deque>
+
+#define SPI2_HOST 1
+#define SPI_DMA_DISABLED 0
+#define SPI_DMA_CH_AUTO 3
+#define SPI_TRANS_USE_RXDATA (1 << 2)
+#define SPI_TRANS_USE_TXDATA (1 << 3)
+#define portMAX_DELAY 0xFFFFFFFF
+
+typedef int esp_err_t;
+typedef struct spi_device_t* spi_device_handle_t;
+
+struct spi_bus_config_t {
+  int mosi_io_num;
+  int miso_io_num;
+  int sclk_io_num;
+  int quadwp_io_num;
+  int quadhd_io_num;
+  int max_transfer_sz;
+};
+
+struct spi_device_interface_config_t {
+  int clock_speed_hz;
+  uint8_t mode;
+  int spics_io_num;
+  int queue_size;
+};
+
+struct spi_transaction_t {
+  uint32_t flags;
+  size_t length; // Bits.
+  uint8_t tx_data[4];
+  uint8_t rx_data[4];
+};
+
+namespace host {
+  // The device on the bus, gets the bytes sent in one chip select and fills in
+  // the bytes received.
+  inline void (*spi_device)(const uint8_t* tx, uint8_t* rx, size_t size) = nullptr;
+  inline int spi_mode = -1;
+  inline int spi_dma_channel = -1;
+  inline std::deque<spi_transaction_t*> spi_done;
+  inline size_t spi_max_queued = 0;
+  inline size_t spi_queue_size = 0;
+
+  inline void spiTransfer(spi_transaction_t* transaction) {
+    spi_device(transaction->tx_data, transaction->rx_data, transaction->length / 8);
+  }
+}
+
+inline esp_err_t spi_bus_initialize(int, const spi_bus_config_t*, int dma_channel) {
+  host::spi_dma_channel = dma_channel;
+  return 0;
+}
+
+inline esp_err_t spi_bus_add_device(int, const spi_device_interface_config_t* config, spi_device_handle_t*) {
+  host::spi_mode = config->mode;
+  host::spi_queue_size = config->queue_size;
+  return 0;
+}
+
+inline esp_err_t spi_device_acquire_bus(spi_device_handle_t, uint32_t) { return 0; }
+inline void spi_device_release_bus(spi_device_handle_t) {}
+
+inline esp_err_t spi_device_queue_trans(spi_device_handle_t, spi_transaction_t* transaction, uint32_t) {
+  host::spiTransfer(transaction);
+  host::spi_done.push_back(transaction);
+  host::spi_max_queued = std::max(host::spi_max_queued, host::spi_done.size());
+  return 0;
+}
+
+inline esp_err_t spi_device_get_trans_result(spi_device_handle_t, spi_transaction_t** transaction, uint32_t) {
+  *transaction = host::spi_done.front();
+  host::spi_done.pop_front();
+  return 0;
+}
+
+inline esp_err_t spi_device_polling_transmit(spi_device_handle_t, spi_transaction_t* transaction) {
+  host::spiTransfer(transaction);
+  return 0;
+}
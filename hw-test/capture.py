@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""Decode a binary capture from hw-test.ino and print per channel statistics.
+
+Usage:
+  capture.py --port /dev/ttyUSB0 --pins 36,39,34 --seconds 5 [--save capture.bin]
+  capture.py --port /dev/ttyUSB0 --imu --seconds 30 --save imu.bin
+  capture.py --file capture.bin
+
+Requires numpy, and pyserial when reading from a port.
+"""
+import argparse
+import struct
+import sys
+import time
+
+import numpy as np
+
+HEADER = struct.Struct("<2sBBIII")
+CAPTURE_BAUD_RATE = 921600
+IMU_CHANNELS = ["ax", "ay", "az", "gx", "gy", "gz"]
+
+
+def parse_blocks(data):
+    """Yield (block, start_us, end_us, samples[sweeps][pins]) for every block in data."""
+    offset = 0
+    while True:
+        offset = data.find(b"OG", offset)
+        if offset < 0 or offset + HEADER.size > len(data):
+            return
+        sync, pins, sweeps, block, start_us, end_us = HEADER.unpack_from(data, offset)
+        size = pins * sweeps * 2
+        end = offset + HEADER.size + size
+        if pins == 0 or sweeps == 0 or end > len(data):
+            offset += 1
+            continue
+        samples = np.frombuffer(data, dtype="<u2", count=pins * sweeps, offset=offset + HEADER.size)
+        yield block, start_us, end_us, samples.reshape(sweeps, pins)
+        offset = end
+
+
+def read_port(port, pins, seconds):
+    """Capture the pins, or the IMU if pins is None."""
+    import serial
+
+    link = serial.Serial(port, 115200, timeout=1)
+    time.sleep(0.5)
+    link.reset_input_buffer()
+    if pins is None:
+        link.write(b"i\n")
+        # The IMU is reset and configured first.
+        time.sleep(0.4)
+    else:
+        link.write(b"c\n")
+        time.sleep(0.2)
+        link.write((",".join(str(p) for p in pins) + "\n").encode())
+        time.sleep(0.2)
+    link.reset_input_buffer()
+    link.baudrate = CAPTURE_BAUD_RATE
+
+    data = bytearray()
+    end = time.time() + seconds
+    while time.time() < end:
+        data += link.read(4096)
+
+    # Stop the capture.
+    link.write(b"\n")
+    link.close()
+    return bytes(data)
+
+
+def noise_peak(blocks, channel):
+    """Frequency of the strongest noise component of a channel.
+
+    The blocks are separated by the time spent sending them, so the spectrum is
+    taken over each block on its own timestamps and averaged, instead of over
+    the concatenated samples.
+    """
+    sweeps = blocks[0][3].shape[0]
+    # Blocks are short, window and zero pad them so the peak falls between
+    # the coarse bins of a single block.
+    window = np.hanning(sweeps)
+    size = max(256, sweeps * 8)
+    spectra = []
+    rates = []
+    for _, start_us, end_us, samples in blocks:
+        duration_us = (end_us - start_us) & 0xFFFFFFFF
+        if samples.shape[0] != sweeps or sweeps < 4 or duration_us == 0:
+            continue
+        # The first and last sample of a block are sweeps - 1 periods apart.
+        rates.append((sweeps - 1) / (duration_us / 1e6))
+        values = samples[:, channel].astype(float)
+        spectra.append(np.abs(np.fft.rfft((values - values.mean()) * window, size)) ** 2)
+    if not spectra:
+        return 0
+
+    power = np.mean(spectra, axis=0)
+    freqs = np.fft.rfftfreq(size, 1 / np.mean(rates))
+    return freqs[1:][np.argmax(power[1:])]
+
+
+def report(data, pin_names, signed=False):
+    """Print the statistics, signed for the IMU's readings."""
+    blocks = list(parse_blocks(data))
+    if signed:
+        blocks = [(block, start_us, end_us, samples.view("<i2")) for block, start_us, end_us, samples in blocks]
+    if not blocks:
+        print("No capture blocks found.")
+        return
+
+    numbers = [b[0] for b in blocks]
+    lost = sum(max(0, b - a - 1) for a, b in zip(numbers, numbers[1:]))
+    samples = np.concatenate([b[3] for b in blocks])
+    pins = samples.shape[1]
+    names = pin_names if len(pin_names) == pins else [str(i) for i in range(pins)]
+
+    # Sampling time inside blocks only, the gaps between blocks are spent sending.
+    sampling_us = sum((b[2] - b[1]) & 0xFFFFFFFF for b in blocks)
+    total_us = (blocks[-1][2] - blocks[0][1]) & 0xFFFFFFFF
+    sweep_rate = samples.shape[0] / (sampling_us / 1e6) if sampling_us else 0
+    effective_rate = samples.shape[0] / (total_us / 1e6) if total_us else 0
+
+    print(f"Blocks: {len(blocks)}  lost: {lost}  sweeps: {samples.shape[0]}  channels: {pins}")
+    print(f"ADC rate while sampling: {sweep_rate * pins:.0f} samples/s ({sweep_rate:.0f} sweeps/s)")
+    print(f"Effective rate including transfer: {effective_rate * pins:.0f} samples/s ({effective_rate:.0f} sweeps/s)")
+    print()
+
+    print(f"{'pin':>5} {'mean':>8} {'std':>7} {'p2p':>6} {'settle':>7} {'peak Hz':>8}")
+    for i in range(pins):
+        channel = samples[:, i].astype(float)
+
+        peak = noise_peak(blocks, i)
+
+        # Settling: how much the first sweep of each block differs from the rest,
+        # the ADC input has been idle (sending) right before it.
+        firsts = np.array([b[3][0, i] for b in blocks], dtype=float)
+        rests = np.array([b[3][1:, i].mean() for b in blocks if b[3].shape[0] > 1], dtype=float)
+        settle = (firsts[:len(rests)] - rests).mean() if len(rests) else 0
+
+        print(f"{names[i]:>5} {channel.mean():8.1f} {channel.std():7.2f} {np.ptp(channel):6.0f} "
+              f"{settle:7.2f} {peak:8.1f}")
+
+    # Crosstalk between channels that are sampled one after another.
+    if pins > 1:
+        print()
+        print("Correlation with the previously sampled channel (mux/ADC crosstalk):")
+        for i in range(pins):
+            previous = (i - 1) % pins
+            a = samples[:, i].astype(float)
+            b = samples[:, previous].astype(float)
+            if a.std() > 0 and b.std() > 0:
+                corr = np.corrcoef(a, b)[0, 1]
+                print(f"  {names[previous]} -> {names[i]}: {corr:+.3f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", help="Serial port the board running hw-test is on.")
+    parser.add_argument("--pins", default="", help="Comma separated pins to capture.")
+    parser.add_argument("--imu", action="store_true", help="Capture the IMU instead of pins, for host-test/imu_bench.")
+    parser.add_argument("--seconds", type=float, default=5, help="How long to capture for.")
+    parser.add_argument("--file", help="Decode a previously saved capture instead of reading a port.")
+    parser.add_argument("--save", help="Save the raw capture to this file.")
+    args = parser.parse_args()
+
+    pins = [p for p in args.pins.split(",") if p]
+    if args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+    elif args.port and args.imu:
+        data = read_port(args.port, None, args.seconds)
+    elif args.port and pins:
+        data = read_port(args.port, pins, args.seconds)
+    else:
+        parser.print_help()
+        return 1
+
+    if args.save:
+        with open(args.save, "wb") as f:
+            f.write(data)
+
+    if args.imu:
+        report(data, IMU_CHANNELS, signed=True)
+    else:
+        report(data, pins)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,27 +1,189 @@
+#include <Wire.h>
+
 enum State {
   SELECT_PIN,
   WAIT_TO_START,
   MONITOR_PIN,
+  SELECT_CAPTURE_PINS,
+  CAPTURE,
+  CAPTURE_IMU,
 };
 
+// Binary capture settings.
+#define CAPTURE_MAX_PINS     16
+#define CAPTURE_BLOCK_SWEEPS 32 // How many round robin sweeps of all pins are sent per block.
+#define CAPTURE_BAUD_RATE    921600
+
+// IMU capture settings, keep them the same as the IMU settings in
+// open-gloves/Config.h so host-test/imu_bench can run the capture.
+#define IMU_I2C_ADDRESS      0x68
+#define PIN_IMU_SDA          21
+#define PIN_IMU_SCL          17
+#define IMU_SAMPLE_RATE      250  // Hz, must divide 1000.
+#define IMU_GYRO_FS_SEL      3    // 0-3 for 250, 500, 1000 or 2000 degrees per second.
+#define IMU_CHANNELS         6    // Accelerometer x, y, z then gyro x, y, z.
+
 State state = State::SELECT_PIN;
 int pin = -1;
 
+int capture_pins[CAPTURE_MAX_PINS];
+int capture_pin_count = 0;
+uint32_t capture_block = 0;
+
+// A capture block is sent as:
+//   uint8_t  sync[2]     'O', 'G'
+//   uint8_t  pin_count
+//   uint8_t  sweeps
+//   uint32_t block       Incremented for every block, gaps mean lost blocks.
+//   uint32_t start_us    Time the first sample of the block was taken.
+//   uint32_t end_us      Time the last sample of the block was taken.
+//   uint16_t samples[sweeps][pin_count]
+// All values are little endian. An IMU capture has the 6 channels of the
+// FIFO per sweep, the raw signed readings at +-4g and IMU_GYRO_FS_SEL, one
+// sweep per sample at IMU_SAMPLE_RATE.
+struct CaptureBlock {
+  uint8_t sync[2];
+  uint8_t pin_count;
+  uint8_t sweeps;
+  uint32_t block;
+  uint32_t start_us;
+  uint32_t end_us;
+  uint16_t samples[CAPTURE_BLOCK_SWEEPS * CAPTURE_MAX_PINS];
+};
+
+CaptureBlock capture_buffer;
+
 void setup() {
   Serial.begin(115200);
   delay(300);
 }
 
+// Drop the rest of the current input line. readString() would wait for its
+// timeout and swallow whatever is sent right after, like the capture pin list.
+void skipLine() {
+  Serial.readStringUntil('\n');
+}
+
+void captureBlock() {
+  capture_buffer.sync[0] = 'O';
+  capture_buffer.sync[1] = 'G';
+  capture_buffer.pin_count = capture_pin_count;
+  capture_buffer.sweeps = CAPTURE_BLOCK_SWEEPS;
+  capture_buffer.block = capture_block++;
+
+  // Sample all the pins round robin as fast as the ADC allows.
+  uint16_t* sample = capture_buffer.samples;
+  capture_buffer.start_us = micros();
+  for (int sweep = 0; sweep < CAPTURE_BLOCK_SWEEPS; sweep++) {
+    for (int i = 0; i < capture_pin_count; i++) {
+      *sample++ = analogRead(capture_pins[i]);
+    }
+  }
+  capture_buffer.end_us = micros();
+
+  // Only send the samples actually used.
+  size_t size = offsetof(CaptureBlock, samples) + (sample - capture_buffer.samples) * sizeof(uint16_t);
+  Serial.write((const uint8_t*)&capture_buffer, size);
+}
+
+void imuWrite(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(IMU_I2C_ADDRESS);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+}
+
+// Reads count registers starting at reg into data.
+void imuRead(uint8_t reg, uint8_t* data, int count) {
+  Wire.beginTransmission(IMU_I2C_ADDRESS);
+  Wire.write(reg);
+  Wire.endTransmission(false);
+  Wire.requestFrom(IMU_I2C_ADDRESS, count);
+  for (int i = 0; i < count; i++) data[i] = Wire.read();
+}
+
+// The same setup as open-gloves/IMU.hpp.
+void imuSetup() {
+  Wire.begin(PIN_IMU_SDA, PIN_IMU_SCL);
+  Wire.setClock(400000);
+  imuWrite(0x6B, 0x80); // Reset.
+  delay(100);
+  imuWrite(0x6B, 0x01); // Clock from the gyro PLL.
+  imuWrite(0x1A, IMU_SAMPLE_RATE >= 400 ? 1 : IMU_SAMPLE_RATE >= 200 ? 2 : 3);
+  imuWrite(0x19, 1000 / IMU_SAMPLE_RATE - 1);
+  imuWrite(0x1B, IMU_GYRO_FS_SEL << 3);
+  imuWrite(0x1C, 0x08); // +-4g
+  imuWrite(0x38, 0x10); // Flag FIFO overflows in INT_STATUS.
+  imuWrite(0x6A, 0x04); // Reset the FIFO.
+  imuWrite(0x6A, 0x40);
+  imuWrite(0x23, 0x78); // Gyro and accelerometer into the FIFO.
+}
+
+void captureImuBlock() {
+  const int block_bytes = CAPTURE_BLOCK_SWEEPS * IMU_CHANNELS * 2;
+  uint8_t count[2];
+  imuRead(0x72, count, 2);
+  if (((count[0] << 8) | count[1]) < block_bytes) return;
+
+  // An overflow drops samples and misaligns the FIFO, start over. The skipped
+  // block number shows up as a lost block.
+  uint8_t status;
+  imuRead(0x3A, &status, 1);
+  if (status & 0x10) {
+    imuWrite(0x6A, 0x04);
+    imuWrite(0x6A, 0x40);
+    capture_block++;
+    return;
+  }
+
+  capture_buffer.sync[0] = 'O';
+  capture_buffer.sync[1] = 'G';
+  capture_buffer.pin_count = IMU_CHANNELS;
+  capture_buffer.sweeps = CAPTURE_BLOCK_SWEEPS;
+  capture_buffer.block = capture_block++;
+  // The samples were taken over the block's length up to now.
+  capture_buffer.end_us = micros();
+  capture_buffer.start_us = capture_buffer.end_us - (CAPTURE_BLOCK_SWEEPS - 1) * (1000000 / IMU_SAMPLE_RATE);
+
+  // Read in pieces that fit the Wire buffer.
+  uint16_t* sample = capture_buffer.samples;
+  for (int sweep = 0; sweep < CAPTURE_BLOCK_SWEEPS; sweep += 8) {
+    uint8_t data[8 * IMU_CHANNELS * 2];
+    imuRead(0x74, data, sizeof(data));
+    for (int i = 0; i < (int)sizeof(data); i += 2) {
+      *sample++ = (data[i] << 8) | data[i + 1];
+    }
+  }
+
+  size_t size = offsetof(CaptureBlock, samples) + (sample - capture_buffer.samples) * sizeof(uint16_t);
+  Serial.write((const uint8_t*)&capture_buffer, size);
+}
+
 void loop() {
   switch (state){
     case SELECT_PIN: {
-      Serial.printf("Select the GPIO pin you want to test [1-40]: \n");
+      Serial.printf("Select the GPIO pin you want to test [1-40], 'c' for a binary capture of several pins or 'i' for a binary capture of the IMU: \n");
       // Wait for user input
       while (!Serial.available()) {};
+      if (Serial.peek() == 'c' || Serial.peek() == 'C') {
+        skipLine();
+        state = SELECT_CAPTURE_PINS;
+        break;
+      }
+      if (Serial.peek() == 'i' || Serial.peek() == 'I') {
+        skipLine();
+        Serial.printf("Capturing the IMU at %d baud. Send any character to stop.\n", CAPTURE_BAUD_RATE);
+        Serial.flush();
+        Serial.updateBaudRate(CAPTURE_BAUD_RATE);
+        imuSetup();
+        capture_block = 0;
+        state = CAPTURE_IMU;
+        break;
+      }
       // Parse the int
       pin = Serial.parseInt();
       // Read the newline char
-      Serial.readString();
+      skipLine();
       state = WAIT_TO_START;
       break;
     }
@@ -29,13 +191,13 @@ void loop() {
       Serial.printf("Pin %d selected. Send any character to start monitoring. Send any character to stop.", pin);
       // Wait for user input
       while (!Serial.available()) {};
-      Serial.readString();
+      skipLine();
       state = MONITOR_PIN;
       break;
     }
     case MONITOR_PIN: {
       if (Serial.available()) {
-        Serial.readString();
+        skipLine();
         state = SELECT_PIN;
       } else {
         Serial.printf("Pin %d: %d\n", pin, analogRead(pin));
@@ -44,5 +206,53 @@ void loop() {
       }
       break;
     }
+    case SELECT_CAPTURE_PINS: {
+      Serial.printf("Enter the GPIO pins to capture separated by commas (max %d): \n", CAPTURE_MAX_PINS);
+      // Wait for user input
+      while (!Serial.available()) {};
+      capture_pin_count = 0;
+      while (capture_pin_count < CAPTURE_MAX_PINS) {
+        int next = Serial.parseInt();
+        if (next <= 0) break;
+        capture_pins[capture_pin_count++] = next;
+        if (Serial.peek() != ',') break;
+      }
+      // Read the newline char
+      skipLine();
+
+      if (capture_pin_count == 0) {
+        state = SELECT_PIN;
+        break;
+      }
+
+      Serial.printf("Capturing %d pins at %d baud. Send any character to stop.\n", capture_pin_count, CAPTURE_BAUD_RATE);
+      Serial.flush();
+      Serial.updateBaudRate(CAPTURE_BAUD_RATE);
+      capture_block = 0;
+      state = CAPTURE;
+      break;
+    }
+    case CAPTURE: {
+      if (Serial.available()) {
+        skipLine();
+        Serial.flush();
+        Serial.updateBaudRate(115200);
+        state = SELECT_PIN;
+      } else {
+        captureBlock();
+      }
+      break;
+    }
+    case CAPTURE_IMU: {
+      if (Serial.available()) {
+        skipLine();
+        Serial.flush();
+        Serial.updateBaudRate(115200);
+        state = SELECT_PIN;
+      } else {
+        captureImuBlock();
+      }
+      break;
+    }
   };
 }
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Config.h"
+
+#if ENABLE_ADC_CORRECTION && defined(ESP32)
+  #include <esp_adc_cal.h>
+  #define ADC_CORRECTION_ACTIVE true
+#else
+  #define ADC_CORRECTION_ACTIVE false
+#endif
+
+// The ESP32 ADC is nonlinear, especially near both rails. This builds a table
+// from the calibration characteristics burned into the chip's eFuses once at
+// startup, so correcting a sample is a single lookup instead of running the
+// esp_adc_cal conversion every time. On other boards this is a plain analogRead().
+//
+// ADC1 and ADC2 are characterized separately, each has its own table. Either way
+// the result is scaled from the built in ADC's range to ANALOG_MAX, which can
+// be larger with a high resolution external ADC.
+class ADCCorrection {
+ public:
+  static void setup() {
+    #if ADC_CORRECTION_ACTIVE
+      // Arduino defaults to 12 bits at 11dB attenuation.
+      buildTable(ADC_UNIT_1, table[0]);
+      buildTable(ADC_UNIT_2, table[1]);
+    #endif
+  }
+
+  static inline int read(int pin) {
+    #if ADC_CORRECTION_ACTIVE
+      return table[unitOf(pin)][analogRead(pin) & BUILTIN_ANALOG_MAX];
+    #elif ANALOG_MAX != BUILTIN_ANALOG_MAX
+      return (long)analogRead(pin) * (ANALOG_MAX + 1L) / (BUILTIN_ANALOG_MAX + 1L);
+    #else
+      return analogRead(pin);
+    #endif
+  }
+
+ private:
+  #if ADC_CORRECTION_ACTIVE
+    // Arduino numbers the ADC2 channels from 10.
+    static constexpr int FIRST_ADC2_CHANNEL = 10;
+
+    static inline int unitOf(int pin) {
+      return digitalPinToAnalogChannel(pin) >= FIRST_ADC2_CHANNEL ? 1 : 0;
+    }
+
+    static void buildTable(adc_unit_t unit, uint16_t* unit_table) {
+      esp_adc_cal_characteristics_t characteristics;
+      esp_adc_cal_characterize(unit, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12,
+                               ADC_CORRECTION_DEFAULT_VREF, &characteristics);
+
+      // Rescale the corrected voltages back onto the raw range so everything
+      // downstream still works in 0 to ANALOG_MAX.
+      uint32_t low = esp_adc_cal_raw_to_voltage(0, &characteristics);
+      uint32_t high = esp_adc_cal_raw_to_voltage(BUILTIN_ANALOG_MAX, &characteristics);
+      for (int raw = 0; raw <= BUILTIN_ANALOG_MAX; raw++) {
+        uint32_t voltage = esp_adc_cal_raw_to_voltage(raw, &characteristics);
+        unit_table[raw] = (voltage - low) * ANALOG_MAX / (high - low);
+      }
+    }
+
+    static uint16_t table[2][BUILTIN_ANALOG_MAX + 1];
+  #endif
+};
+
+#if ADC_CORRECTION_ACTIVE
+  uint16_t ADCCorrection::table[2][BUILTIN_ANALOG_MAX + 1];
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Config.h"
+
+#include "ADCCorrection.hpp"
+#include "SPIADC.hpp"
+
+// Where the analog inputs get their samples from. Pins from
+// EXTERNAL_ADC_PIN(channel) are channels of the external SPI ADC, every other
+// pin is read from the built in ADC. Either way the value is in 0 to ANALOG_MAX.
+class AnalogSource {
+ public:
+  static void setup() {
+    ADCCorrection::setup();
+    ExternalADC::setup();
+  }
+
+  // Take this loop's samples from sources that are read all at once.
+  static void sample() {
+    ExternalADC::sample();
+  }
+
+  static inline int read(int pin) {
+    #if EXTERNAL_ADC != EXTERNAL_ADC_NONE
+      if (pin >= EXTERNAL_ADC_PIN_BASE) return ExternalADC::read(pin - EXTERNAL_ADC_PIN_BASE);
+    #endif
+    return ADCCorrection::read(pin);
+  }
+};
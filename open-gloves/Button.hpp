@@ -3,18 +3,95 @@
 #include "Config.h"
 
 #include "DriverProtocol.hpp"
+#include "SampleTrace.hpp"
+
+// Edge interrupts with an argument are only available on the ESP32, other
+// boards fall back to polling the pin every loop. Power saving uses the pins
+// as level wakeups instead, which replaces their edge interrupts.
+#if ENABLE_BUTTON_INTERRUPTS && !ENABLE_POWER_SAVING && defined(ESP32)
+  #define BUTTON_USE_INTERRUPTS true
+#else
+  #define BUTTON_USE_INTERRUPTS false
+#endif
+
+// Size of the edge event queue, must be a power of two.
+#define BUTTON_EVENT_QUEUE_SIZE 16
 
 class Button : public EncodedInput {
  public:
   Button(EncodedInput::Type type, int pin, bool invert) :
-    type(type), pin(pin), on_state(invert ? HIGH : LOW), value(false) {}
+    type(type), pin(pin), on_state(invert ? HIGH : LOW), value(false),
+    event_head(0), event_tail(0), event_overflow(false),
+    raw_level(!on_state), raw_since(0), debounced(false),
+    press_latched(false), pressed_edge(false), next_attached(nullptr), next_on_pin(nullptr) {}
 
   void setupInput() override {
     pinMode(pin, INPUT_PULLUP);
+    raw_level = digitalRead(pin);
+    raw_since = micros();
+    debounced = (raw_level == on_state);
+
+    #if BUTTON_USE_INTERRUPTS
+      // Only one handler can be attached to a pin, buttons sharing a pin get
+      // their edges from the button that attached it.
+      for (Button* other = attached; other != nullptr; other = other->next_attached) {
+        if (other->pin == pin) {
+          next_on_pin = other->next_on_pin;
+          other->next_on_pin = this;
+          return;
+        }
+      }
+      next_attached = attached;
+      attached = this;
+      attachInterruptArg(digitalPinToInterrupt(pin), onEdge, this, CHANGE);
+    #endif
   }
 
   virtual void readInput() {
-    value = (digitalRead(pin) == on_state);
+    unsigned long now = SampleTrace::frameTime();
+
+    if (SampleTrace::getMode() == SampleTrace::REPLAYING) {
+      // The recorded pin level goes through the debouncing again, the edges
+      // of the real pin are dropped.
+      event_tail = event_head;
+      event_overflow = false;
+      applyLevel(now, SampleTrace::digital(raw_level));
+    } else {
+      #if !BUTTON_USE_INTERRUPTS
+        // No interrupts available, poll the pin and feed changes through
+        // the same queue so they get debounced the same way.
+        bool level = digitalRead(pin);
+        if (level != raw_level) pushEvent(micros(), level);
+      #endif
+
+      if (event_overflow) {
+        // Events were lost, the queue can't be trusted so resync with the pin.
+        event_tail = event_head;
+        event_overflow = false;
+        applyLevel(now, digitalRead(pin));
+      }
+
+      // Drain all edges recorded since the last loop.
+      while (event_tail != event_head) {
+        applyLevel(events[event_tail].time, events[event_tail].level);
+        event_tail = (event_tail + 1) & (BUTTON_EVENT_QUEUE_SIZE - 1);
+      }
+
+      // Record the raw level, not the debounced one.
+      SampleTrace::digital(raw_level);
+    }
+
+    // Commit the current level if it has been stable long enough.
+    settle(now);
+
+    // Report presses that started and ended between frames as well.
+    value = debounced || press_latched;
+    pressed_edge = press_latched;
+    press_latched = false;
+  }
+
+  EncodedInput::Type getType() const override {
+    return type;
   }
 
   inline int getEncodedSize() const override {
@@ -27,13 +104,92 @@ class Button : public EncodedInput {
     return value ? 1 : 0;
   }
 
+  int getPin() const {
+    return pin;
+  }
+
   bool isPressed() const {
     return value;
   }
 
+  // True only for the frame in which a new debounced press was detected.
+  bool pressedThisFrame() const {
+    return pressed_edge;
+  }
+
  private:
+  struct Event {
+    unsigned long time;
+    bool level;
+  };
+
+  // Single producer (ISR) single consumer (loop) queue. The head is only
+  // written by the producer and the tail only by the consumer.
+  void pushEvent(unsigned long time, bool level) {
+    uint8_t next = (event_head + 1) & (BUTTON_EVENT_QUEUE_SIZE - 1);
+    if (next == event_tail) {
+      event_overflow = true;
+      return;
+    }
+
+    events[event_head].time = time;
+    events[event_head].level = level;
+    event_head = next;
+  }
+
+  #if BUTTON_USE_INTERRUPTS
+    static void IRAM_ATTR onEdge(void* arg) {
+      Button* button = static_cast<Button*>(arg);
+      unsigned long time = micros();
+      bool level = digitalRead(button->pin);
+      for (; button != nullptr; button = button->next_on_pin) {
+        button->pushEvent(time, level);
+      }
+    }
+
+    // The buttons that attached an interrupt to their pin.
+    static Button* attached;
+  #endif
+
+  // A raw level only becomes the debounced state after it has been stable
+  // for BUTTON_DEBOUNCE_MS.
+  void settle(unsigned long time) {
+    bool pressed = (raw_level == on_state);
+    if (pressed != debounced && (long)(time - raw_since) >= BUTTON_DEBOUNCE_MS * 1000L) {
+      debounced = pressed;
+      if (pressed) press_latched = true;
+    }
+  }
+
+  void applyLevel(unsigned long time, bool level) {
+    // The previous level lasted until this edge, see if it was stable.
+    settle(time);
+    if (level != raw_level) {
+      raw_level = level;
+      raw_since = time;
+    }
+  }
+
   const EncodedInput::Type type;
   const int pin;
   const bool on_state;
   bool value;
+
+  volatile Event events[BUTTON_EVENT_QUEUE_SIZE];
+  volatile uint8_t event_head;
+  volatile uint8_t event_tail;
+  volatile bool event_overflow;
+
+  bool raw_level;
+  unsigned long raw_since;
+  bool debounced;
+  bool press_latched;
+  bool pressed_edge;
+
+  Button* next_attached;
+  Button* volatile next_on_pin;
 };
+
+#if BUTTON_USE_INTERRUPTS
+  Button* Button::attached = nullptr;
+#endif
@@ -13,6 +13,14 @@ class Calibrated {
  public:
   virtual void resetCalibration() = 0;
 
+  // Use the calibration stored in the settings, eg. after they were changed.
+  virtual void loadCalibration() {}
+
+  // Capture a point of a curve calibration from the current position, or clear
+  // all of them again. See LookupTableCalibrator.
+  virtual void capturePoint(int index) {}
+  virtual void clearPoints() {}
+
   virtual void enableCalibration() {
     calibrate = true;
   }
@@ -27,9 +35,14 @@ class Calibrated {
 
 template<typename T>
 struct Calibrator {
+  // Number of points that can be captured with setPoint, none for most.
+  static constexpr int POINTS = 0;
+
   virtual void reset() = 0;
   virtual void update(T input) = 0;
   virtual T calibrate(T input) const = 0;
+
+  void setPoint(int index, T input) {}
 };
 
 template<typename T, T output_min, T output_max>
@@ -65,6 +78,227 @@ class MinMaxCalibrator : public Calibrator<T> {
   T value_max;
 };
 
+// Calibrates to the range between a low and high percentile of all samples seen,
+// so single outliers (ADC glitches, a bent sensor) don't widen the range like they
+// do with MinMaxCalibrator. Percentiles are given in per mille, so 10 and 990 are
+// the 1st and 99th percentile.
+//
+// The distribution is tracked in a fixed number of histogram bins over the output
+// range. The bins containing the percentiles are moved incrementally as samples come
+// in, so an update costs a handful of operations. Once the counts saturate they are
+// halved, which keeps memory constant and slowly ages out old samples.
+template<typename T, T output_min, T output_max, int low_permille, int high_permille, int bins = 32>
+class PercentileCalibrator : public Calibrator<T> {
+ public:
+  PercentileCalibrator() {
+    reset();
+  }
+
+  void reset() {
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    low_bin = 0;
+    below_low = 0;
+    high_bin = bins - 1;
+    above_high = 0;
+    value_min = output_max;
+    value_max = output_min;
+  }
+
+  void update(T input) {
+    int bin = binOf(input);
+    counts[bin]++;
+    total++;
+    if (bin < low_bin) below_low++;
+    if (bin > high_bin) above_high++;
+
+    // Halve the histogram before any of the counts can overflow.
+    if (total == UINT16_MAX) decay();
+
+    // Number of samples that should be below the low and above the high percentile.
+    uint32_t low_rank = (uint32_t)total * low_permille / 1000;
+    uint32_t high_rank = (uint32_t)total * (1000 - high_permille) / 1000;
+
+    // Step the bins until they contain the percentile again. This is usually zero
+    // or one step per sample.
+    while (low_bin > 0 && below_low > low_rank) {
+      below_low -= counts[--low_bin];
+    }
+    while (low_bin < bins - 1 && below_low + counts[low_bin] <= low_rank) {
+      below_low += counts[low_bin++];
+    }
+    while (high_bin < bins - 1 && above_high > high_rank) {
+      above_high -= counts[++high_bin];
+    }
+    while (high_bin > 0 && above_high + counts[high_bin] <= high_rank) {
+      above_high += counts[high_bin--];
+    }
+
+    // Interpolate within the bins to find the percentile values.
+    value_min = binStart(low_bin) + interpolate(low_rank - below_low, counts[low_bin]);
+    value_max = binStart(high_bin + 1) - interpolate(high_rank - above_high, counts[high_bin]);
+  }
+
+  T calibrate(T input) const {
+    // This means we haven't had any calibration data yet.
+    // Return a neutral value right in the middle of the output range.
+    if (value_min >= value_max) return (output_min + output_max) / 2.0f;
+
+    // Map the input range to the output range.
+    T output = accurateMap(input, value_min, value_max, output_min, output_max);
+
+    // Lock the range to the output.
+    return constrain(output, output_min, output_max);
+  }
+
+ private:
+  static constexpr long RANGE = (long)output_max - output_min + 1;
+
+  static int binOf(T input) {
+    long offset = constrain((long)input - output_min, 0L, RANGE - 1);
+    return offset * bins / RANGE;
+  }
+
+  static T binStart(int bin) {
+    return output_min + (long)bin * RANGE / bins;
+  }
+
+  // Offset into a bin for a rank, assuming samples are spread evenly in it.
+  static T interpolate(uint32_t rank, uint16_t count) {
+    if (count == 0) return 0;
+    return (long)rank * (RANGE / bins) / count;
+  }
+
+  void decay() {
+    total = below_low = above_high = 0;
+    for (int i = 0; i < bins; i++) {
+      counts[i] /= 2;
+      total += counts[i];
+      if (i < low_bin) below_low += counts[i];
+      if (i > high_bin) above_high += counts[i];
+    }
+  }
+
+  uint16_t counts[bins];
+  uint16_t total;
+  int low_bin;
+  uint16_t below_low;
+  int high_bin;
+  uint16_t above_high;
+  T value_min;
+  T value_max;
+};
+
+// Piecewise-linear calibration for nonlinear sensors. The open and closed points
+// are learned like MinMaxCalibrator, the interior points say where evenly spaced
+// outputs sit in the raw range, in per mille of the raw range. For example
+// LookupTableCalibrator<int, 0, ANALOG_MAX, 650> is an open/half/fist calibration
+// where the half curled finger reads 65% of the way between open and fist.
+//
+// Any of the points can also be captured at runtime with setPoint, eg. while
+// the user holds a half curled finger (See the (LC) command in Glove.hpp).
+// Captured points are raw sensor values, so they stay where they were captured
+// when the learned range changes, and they replace the learned ends and the
+// per mille defaults until they are cleared with a point of -1. reset() only
+// starts the learned range over.
+//
+// The curve is sampled into a table of segments whenever the points change, so
+// calibrating a sample is a single lookup and an integer interpolation no matter
+// how many points are used.
+template<typename T, T output_min, T output_max, int... interior_permille>
+class LookupTableCalibrator : public Calibrator<T> {
+ public:
+  static constexpr int POINTS = sizeof...(interior_permille) + 2;
+  static constexpr int SEGMENTS = 16;
+
+  LookupTableCalibrator() {
+    for (int i = 0; i < POINTS; i++) {
+      captured[i] = -1;
+    }
+    reset();
+  }
+
+  void reset() {
+    value_min = output_max;
+    value_max = output_min;
+    rebuild();
+  }
+
+  void update(T input) {
+    // The table only needs rebuilding if the end points moved.
+    bool changed = false;
+    if (input < value_min) { value_min = input; changed = true; }
+    if (input > value_max) { value_max = input; changed = true; }
+    if (changed) rebuild();
+  }
+
+  // Capture the raw value of a point, 0 is open and POINTS - 1 is closed. A
+  // value of -1 clears the point again.
+  void setPoint(int index, T input) {
+    if (index < 0 || index >= POINTS) return;
+    captured[index] = input;
+    rebuild();
+  }
+
+  T calibrate(T input) const {
+    // This means we haven't had any calibration data yet.
+    // Return a neutral value right in the middle of the output range.
+    if (range_min >= range_max) return (output_min + output_max) / 2.0f;
+
+    if (input >= range_max) return table[SEGMENTS];
+
+    // Find the segment and the 16 bit fraction into it.
+    uint32_t position = (uint32_t)(max(input, range_min) - range_min) * scale;
+    int segment = position >> 24;
+    int32_t fraction = (position >> 8) & 0xFFFF;
+
+    return table[segment] + (((int32_t)(table[segment + 1] - table[segment]) * fraction) >> 16);
+  }
+
+ private:
+  void rebuild() {
+    range_min = captured[0] >= 0 ? captured[0] : value_min;
+    range_max = captured[POINTS - 1] >= 0 ? captured[POINTS - 1] : value_max;
+    if (range_min >= range_max) return;
+
+    // Fixed point scale from the raw input to segments, 24 fractional bits.
+    scale = ((uint32_t)SEGMENTS << 24) / (range_max - range_min);
+
+    // Where the points sit in the range, in per mille. Captured points outside
+    // of the range or out of order are clamped to keep the curve monotonic.
+    const int defaults[] = {0, interior_permille..., 1000};
+    long points[POINTS];
+    points[0] = 0;
+    for (int i = 1; i < POINTS; i++) {
+      long permille = defaults[i];
+      if (i < POINTS - 1 && captured[i] >= 0) {
+        permille = accurateMap(captured[i], range_min, range_max, 0, 1000);
+      }
+      points[i] = constrain(permille, points[i - 1], 1000L);
+    }
+
+    // Sample the piecewise-linear curve through the points at each segment.
+    int point = 0;
+    for (int i = 0; i <= SEGMENTS; i++) {
+      long permille = (long)i * 1000 / SEGMENTS;
+      while (point < POINTS - 2 && permille > points[point + 1]) point++;
+
+      long output_low = output_min + (long)(output_max - output_min) * point / (POINTS - 1);
+      long output_high = output_min + (long)(output_max - output_min) * (point + 1) / (POINTS - 1);
+      long span = points[point + 1] - points[point];
+      table[i] = span > 0 ? output_low + (output_high - output_low) * (permille - points[point]) / span : output_high;
+    }
+  }
+
+  T captured[POINTS];
+  T table[SEGMENTS + 1];
+  uint32_t scale;
+  T value_min;
+  T value_max;
+  T range_min;
+  T range_max;
+};
+
 template<typename T, T sensor_max, T driver_max_deviation, T output_min, T output_max>
 class CenterPointDeviationCalibrator : public Calibrator<T> {
  public:
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Config.h"
+
+// Keeps the raw samples, calibration ranges and outputs of all curl and splay
+// channels in contiguous arrays so they are calibrated together by one kernel,
+// instead of each finger calibrating itself through its own calibrator.
+//
+// Both calibrations are an affine map followed by a clamp, so every channel is
+// processed the same way with precomputed fixed point parameters:
+//   output = clamp(((clamp(raw, in_low, in_high) - offset) * scale >> 16) + base, 0, ANALOG_MAX)
+// The parameters are only recalculated when a channel's range changes. The loop
+// runs over the whole fixed size store so the compiler can fully unroll it.
+//
+// Curl channels use min/max calibration like MinMaxCalibrator. Splay channels use
+// the center of their range like CenterPointDeviationCalibrator.
+class ChannelStore {
+ public:
+  enum Kind : uint8_t {
+    CURL,
+    SPLAY
+  };
+
+  ChannelStore() : count(0), dirty(false) {
+    for (int i = 0; i < CHANNEL_STORE_SIZE; i++) {
+      kinds[i] = CURL;
+      calibrating[i] = false;
+      raws[i] = 0;
+      reset(i);
+    }
+  }
+
+  // Register a channel, returns its index.
+  int add(Kind kind) {
+    kinds[count] = kind;
+    reset(count);
+    return count++;
+  }
+
+  inline void setRaw(int channel, int raw) {
+    raws[channel] = raw;
+    dirty = true;
+  }
+
+  // Calibrated output of a channel. The batch is processed the first time an
+  // output is needed after new samples came in.
+  inline int output(int channel) {
+    if (dirty) process();
+    return outputs[channel];
+  }
+
+  // Map any value with a channel's current calibration.
+  int calibrate(int channel, int raw) const {
+    return apply(channel, raw);
+  }
+
+  void setCalibrating(int channel, bool enabled) {
+    calibrating[channel] = enabled;
+  }
+
+  void reset(int channel) {
+    range_min[channel] = ANALOG_MAX;
+    range_max[channel] = 0;
+    updateParameters(channel);
+    dirty = true;
+  }
+
+  void process() {
+    for (int i = 0; i < CHANNEL_STORE_SIZE; i++) {
+      int32_t raw = raws[i];
+      if (calibrating[i] && (raw < range_min[i] || raw > range_max[i])) {
+        range_min[i] = min(range_min[i], (int16_t)raw);
+        range_max[i] = max(range_max[i], (int16_t)raw);
+        updateParameters(i);
+      }
+      outputs[i] = apply(i, raw);
+    }
+    dirty = false;
+  }
+
+ private:
+  inline int apply(int i, int32_t raw) const {
+    raw = constrain(raw, in_low[i], in_high[i]);
+    int32_t output = (((raw - offsets[i]) * scales[i]) >> 16) + bases[i];
+    return constrain(output, 0, ANALOG_MAX);
+  }
+
+  void updateParameters(int i) {
+    if (range_min[i] >= range_max[i]) {
+      // No calibration data yet, output the middle of the range.
+      in_low[i] = 0;
+      in_high[i] = ANALOG_MAX;
+      offsets[i] = 0;
+      scales[i] = 0;
+      bases[i] = ANALOG_MAX / 2;
+      return;
+    }
+
+    if (kinds[i] == CURL) {
+      // Map the range onto the full output. Clamping the input to the range
+      // first keeps the product within 32 bits.
+      in_low[i] = range_min[i];
+      in_high[i] = range_max[i];
+      offsets[i] = range_min[i];
+      scales[i] = ((int32_t)ANALOG_MAX << 16) / (range_max[i] - range_min[i]);
+      bases[i] = 0;
+    } else {
+      // Deviation from the center in sensor degrees, scaled so the maximum
+      // deviation the driver supports covers the full output. Inputs past the
+      // maximum deviation are clamped first to keep the product within 32 bits.
+      int32_t center = (range_min[i] + range_max[i]) / 2;
+      int32_t max_deviation = (int32_t)ANALOG_MAX * DRIVER_MAX_SPLAY / SENSOR_MAX_SPLAY + 1;
+      in_low[i] = max(center - max_deviation, (int32_t)0);
+      in_high[i] = min(center + max_deviation, (int32_t)ANALOG_MAX);
+      offsets[i] = center;
+      scales[i] = ((int32_t)SENSOR_MAX_SPLAY << 16) / (2 * DRIVER_MAX_SPLAY);
+      bases[i] = ANALOG_MAX / 2;
+    }
+  }
+
+  int count;
+  bool dirty;
+
+  Kind kinds[CHANNEL_STORE_SIZE];
+  bool calibrating[CHANNEL_STORE_SIZE];
+  int16_t raws[CHANNEL_STORE_SIZE];
+  int16_t range_min[CHANNEL_STORE_SIZE];
+  int16_t range_max[CHANNEL_STORE_SIZE];
+  int16_t in_low[CHANNEL_STORE_SIZE];
+  int16_t in_high[CHANNEL_STORE_SIZE];
+  int32_t offsets[CHANNEL_STORE_SIZE];
+  int32_t scales[CHANNEL_STORE_SIZE];
+  int32_t bases[CHANNEL_STORE_SIZE];
+  int16_t outputs[CHANNEL_STORE_SIZE];
+};
+
+#if ENABLE_CHANNEL_STORE
+  ChannelStore channel_store;
+#endif
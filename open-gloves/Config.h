@@ -10,32 +10,117 @@
  * github.com/JohnRThomas/opengloves-firmware/
  */
 
-// Automatically set ANALOG_MAX depending on the microcontroller
+#pragma once
+
+// Automatically set BUILTIN_ANALOG_MAX depending on the microcontroller
 #if defined(__AVR__)
-#define ANALOG_MAX 1023
+#define BUILTIN_ANALOG_MAX 1023
 #elif defined(ESP32)
-#define ANALOG_MAX 4095
+#define BUILTIN_ANALOG_MAX 4095
 #else
-#error "This board doesn't have an auto ANALOG_MAX assignment, please set it manually by uncommenting ANALOG_MAX OVERRIDE!"
-//ANALOG_MAX OVERRIDE:
+#error "This board doesn't have an auto BUILTIN_ANALOG_MAX assignment, please set it manually by uncommenting BUILTIN_ANALOG_MAX OVERRIDE!"
+//BUILTIN_ANALOG_MAX OVERRIDE:
 // Uncomment and set as needed (only touch if you know what you are doing)
-//#define ANALOG_MAX 4095
+//#define BUILTIN_ANALOG_MAX 4095
 #endif
 
+// ADC settings
+#define ENABLE_ADC_CORRECTION       true // ESP32 only: Correct the ADC nonlinearity with the chip's eFuse calibration.
+#define ADC_CORRECTION_DEFAULT_VREF 1100 // Reference voltage (mV) used if the chip has no eFuse calibration.
+
+// External SPI ADC (See SPIADC.hpp). Set an analog pin below to EXTERNAL_ADC_PIN(channel) to read it from the external ADC.
+#define EXTERNAL_ADC_NONE     0
+#define EXTERNAL_ADC_MCP3208  1 // 8 channels, 12 bits
+#define EXTERNAL_ADC_ADS8688  2 // 8 channels, 16 bits
+#define EXTERNAL_ADC          EXTERNAL_ADC_NONE
+#define EXTERNAL_ADC_CHANNELS 8       // How many channels are read each loop.
+#define EXTERNAL_ADC_CLOCK    1000000 // SPI clock (Hz), the MCP3208 needs 1MHz or less at 3.3V.
+#define ADS8688_RANGE         0x06    // Input range of all channels, 0x06 is 0 to 1.25 x Vref (0-5.12V).
+#define EXTERNAL_ADC_PIN_BASE 100
+#define EXTERNAL_ADC_PIN(channel) (EXTERNAL_ADC_PIN_BASE + (channel))
+
+// The range all analog inputs are processed and sent in. The ADS8688 gets 15 bits on the ESP32, the most
+// the fixed point calibration holds in 32 bits, and the built in ADC is scaled up to match.
+#if EXTERNAL_ADC == EXTERNAL_ADC_ADS8688 && defined(ESP32)
+#define ANALOG_MAX 32767
+#else
+#define ANALOG_MAX BUILTIN_ANALOG_MAX
+#endif
+
+// Number of digits needed to encode a value in the range 0 to ANALOG_MAX.
+#define ENCODED_VALUE_DIGITS (ANALOG_MAX > 9999 ? 5 : ANALOG_MAX > 999 ? 4 : 3)
+
 // Which communication protocol to use
 #define COMM_USB        0
 #define COMM_BLUETOOTH  1
 #define COMM_WIFI       2
+#define COMM_ESPNOW     3 // ESP32 only, needs a second ESP32 running espnow-bridge.
 #define COMMUNICATION   COMM_USB
 
 // COMM settings
 #define ENABLE_SYNCHRONOUS_COMM true // Experimental: If enabled, doesn't wait for FFB data before sending new input data.
 #define SERIAL_BAUD_RATE        115200
+#define SERIAL_MAX_BAUD_RATE    921600 // Highest baud rate the driver may switch to. Set to SERIAL_BAUD_RATE to disable switching.
+#define SERIAL_TX_BUFFER        1024 // ESP32 only: Frames wait here to go out, so the loop doesn't wait for the wire.
+#define SERIAL_BAUD_VERIFY_TIMEOUT 500 // How long the driver has to confirm a new baud rate (ms)
+#define SERIAL_BAUD_MAX_ERRORS  3      // Corrupted messages in a row at a raised baud rate before falling back.
 #define BT_DEVICE_NAME          "OpenGlove-Left"
 #define WIFI_SERIAL_SSID        "WIFI SSID here"
 #define WIFI_SERIAL_PASSWORD    "password here"
 #define WIFI_SERIAL_PORT        80
+#define WIFI_MAX_SUBSCRIBERS    3    // Read only clients that receive the same frames as the primary client.
+#define WIFI_FANOUT_BUFFER_SIZE 4096 // Frame data kept for the subscribers (bytes)
+#define WIFI_FANOUT_FRAMES      16   // How far a subscriber may fall behind before frames are dropped.
+#define ESPNOW_HAND_LEFT        0
+#define ESPNOW_HAND_RIGHT       1
+#define ESPNOW_HAND             ESPNOW_HAND_LEFT
+#define ESPNOW_BRIDGE_ADDRESS   {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF} // MAC address of the bridge, leave as broadcast to find it automatically.
+#define ESPNOW_CHANNEL          1   // Must match the bridge.
+#define ESPNOW_PHY_RATE         WIFI_PHY_RATE_24M // Faster rates shorten the air time of a frame but reduce the range.
+#define ESPNOW_LINK_TIMEOUT     500 // How long without an acknowledged packet before the link is considered lost (ms)
 #define COMM_DELAY              4 // How much time between data sends (ms)
+#define ENABLE_LOOP_BUDGET      false // Shed optional work (filters, splay/joystick rate, output rate) when loops run late.
+#define LOOP_BUDGET_US          (COMM_DELAY * 1000) // How much time a loop may spend working (us)
+#define LOOP_BUDGET_OVERRUNS    8  // How many loops in a row over budget before shedding work.
+#define LOOP_BUDGET_RECOVERY    64 // How many loops in a row with headroom before restoring work.
+#define ENABLE_FIXED_WIDTH_ENCODING true // Precompute the frame and only patch zero padded values each loop.
+#define ENABLE_BATCHING         false // Experimental: Send several timestamped samples per transmission, for slow links.
+#define BATCH_SAMPLE_PERIOD     1000  // How much time between samples when batching (us)
+#define BATCH_MAX_SAMPLES       8     // The most samples that will be sent in one transmission.
+#define ENABLE_TELEMETRY        false // Add sequence numbers and timestamps to frames and measure the link latency.
+#define TELEMETRY_PING_INTERVAL 1000  // How much time between latency pings (ms)
+#define ENABLE_HANDSHAKE        true  // Advertise capabilities and let the driver pick the encodings and rate when it connects.
+#define HANDSHAKE_MIN_PERIOD    1     // The shortest time between data sends a driver may ask for (ms)
+#define ENABLE_RUNTIME_SETTINGS true  // Allow tuning settings over the communication channel and store them (See Settings.hpp)
+#define SETTINGS_EEPROM_ADDRESS 0     // Where settings are stored on boards without NVS.
+
+// Dual hand settings (See Glove.hpp for more information)
+// One board can drive a second, complete glove with its own pins (the PIN_..._2 pins below), calibration,
+// gestures and force feedback. Both hands use the same features as configured in this file.
+// The first hand is the left hand and the second the right hand.
+#define ENABLE_DUAL_HAND        false
+#define DUAL_HAND_MULTIPLEXED   0 // Both hands on the one communication channel, every line tagged (HL) or (HR) (See HandMultiplexer.hpp)
+#define DUAL_HAND_SEPARATE      1 // Each hand on its own channel, only COMM_WIFI (on WIFI_SERIAL_PORT_2) and COMM_ESPNOW.
+#define DUAL_HAND_STREAMS       DUAL_HAND_MULTIPLEXED
+#define WIFI_SERIAL_PORT_2      (WIFI_SERIAL_PORT + 1) // Port of the second hand with DUAL_HAND_SEPARATE.
+#define IMU_I2C_ADDRESS_2       0x69 // The second hand's IMU, on the same bus with AD0 pulled high.
+// Add the second hand's own gestures here, like CUSTOM_GESTURE_RULES.
+#define CUSTOM_GESTURE_RULES_2
+
+// Power settings (See PowerManager.hpp for more information)
+#define ENABLE_POWER_SAVING     false // ESP32 only: Lower the clock between frames, for battery powered gloves. Light sleep needs a core with tickless idle (See PowerManager.hpp).
+#define POWER_MAX_CPU_MHZ       240   // Clock speed while working.
+#define POWER_MIN_CPU_MHZ       80    // Clock speed while waiting, the radios need at least 80MHz.
+
+// Recording of the raw sensor data for debugging and benchmarking (See SampleTrace.hpp for more information)
+#define RECORD_SINK_FLASH   0 // Keep the most recent data in a ring on flash (ESP32 only)
+#define RECORD_SINK_COMM    1 // Stream the data out the communication channel
+#define ENABLE_RECORDING    false
+#define RECORD_SINK         RECORD_SINK_FLASH
+#define RECORD_FILE         "/trace.bin"
+#define RECORD_MAX_BYTES    (512 * 1024) // Size of the ring on flash.
+#define RECORD_FLUSH_BYTES  2048 // Records are collected in RAM and written to flash in blocks of this size.
+#define RECORD_MAX_CHANNELS (32 * HAND_COUNT) // The most raw values recorded per loop, for all hands.
 
 // Button Settings
 // If a button registers as pressed when not and vice versa (eg. using normally-closed switches),
@@ -49,12 +134,27 @@
 #define INVERT_TRIGGER  false // Does nothing if gesture is enabled
 #define INVERT_GRAB     false // Does nothing if gesture is enabled
 #define INVERT_PINCH    false // Does nothing if gesture is enabled
+#define BUTTON_DEBOUNCE_MS       5    // How long a button must be stable before a change is reported (ms)
+#define ENABLE_BUTTON_INTERRUPTS true // Use pin change interrupts instead of polling (ESP32 only)
 
 // Joystick configuration
 #define ENABLE_JOYSTICK   true // Set to false if not using the joystick
 #define INVERT_JOY_X      false
 #define INVERT_JOY_Y      false
 #define JOYSTICK_DEADZONE 0.1 //deadzone in the joystick to prevent drift. Value out of 1.0.
+#define JOYSTICK_SMOOTHING 2  // Exponential smoothing, each sample moves 1/2^N of the way. 0 to disable.
+
+// IMU settings (See IMU.hpp for more information)
+#define ENABLE_IMU           false  // Send the hand orientation from an MPU6050/MPU6500 on I2C.
+#define IMU_I2C_ADDRESS      0x68
+#define IMU_SAMPLE_RATE      250    // How often the IMU is sampled and fused (Hz). Must divide 1000.
+#define IMU_MAX_SAMPLES      4      // Not ESP32: Most samples read per loop, each takes ~0.3ms of blocking I2C. The rest wait in the FIFO.
+#define IMU_TASK_PERIOD      8      // ESP32 only: How often the IMU task on the other core empties the FIFOs (ms). They hold 42 samples.
+#define IMU_TASK_CORE        0      // ESP32 only: The core the IMU task runs on, the loop runs on core 1.
+#define IMU_GYRO_RANGE       2000   // Gyro full scale: 250, 500, 1000 or 2000 degrees per second.
+#define IMU_GYRO_LSB_PER_DPS (32768.0 / IMU_GYRO_RANGE)
+#define IMU_MAHONY_KP        1.0    // How strongly gravity corrects the orientation.
+#define IMU_MAHONY_KI        0.0    // How strongly gravity corrects the gyro drift, 0 to disable.
 
 // Finger settings
 #define ENABLE_THUMB        true  // If for some reason you don't want to track the thumb
@@ -65,15 +165,31 @@
 // Calibration Settings (See Calibration.hpp for more information)
 #define CALIBRATION_LOOPS   -1 // How many loops should be calibrated. Set to -1 to always be calibrated.
 #define CALIBRATION_CURL    MinMaxCalibrator<int, 0, ANALOG_MAX>
+//#define CALIBRATION_CURL  PercentileCalibrator<int, 0, ANALOG_MAX, 10, 990> // Use the 1st-99th percentile, ignores outliers.
+//#define CALIBRATION_CURL  LookupTableCalibrator<int, 0, ANALOG_MAX, 650> // Nonlinear sensors, half curl reads 65% of the raw range. Capture it with (LC)1.
 #define DRIVER_MAX_SPLAY    20  // The maximum deviation from the center point the driver supports.
 #define SENSOR_MAX_SPLAY    270 // The maximum total range of rotation of the sensor.
 #define CALIBRATION_SPLAY   CenterPointDeviationCalibrator<int, SENSOR_MAX_SPLAY, DRIVER_MAX_SPLAY, 0, ANALOG_MAX>
+#define ENABLE_CHANNEL_STORE false // Calibrate all curl and splay channels in one batch (See ChannelStore.hpp). Replaces CALIBRATION_CURL and CALIBRATION_SPLAY.
 
 // Gesture enables, make false to use button override
 #define TRIGGER_GESTURE true
 #define GRAB_GESTURE    true
 #define PINCH_GESTURE   (true && ENABLE_THUMB) // Cannot be enabled if there is no thumb
 
+// Gesture rules: {key, {thumb, index, middle, ring, pinky weights}, press, release, hold time (ms)}
+// A gesture is pressed when the weighted average flexion of the fingers reaches the press threshold
+// and released when it drops below the release threshold, both per mille of the flexion range.
+// Keeping them apart stops gestures from flickering near the threshold. Changes only take effect
+// after holding for the hold time.
+#define TRIGGER_GESTURE_RULE {EncodedInput::Type::TRIGGER, {0, 1, 0, 0, 0}, 550, 450, 0}
+#define GRAB_GESTURE_RULE    {EncodedInput::Type::GRAB,    {0, 1, 1, 1, 1}, 550, 450, 0}
+#define PINCH_GESTURE_RULE   {EncodedInput::Type::PINCH,   {1, 1, 0, 0, 0}, 550, 450, 0}
+// Add your own gestures here, each followed by a comma. For example, a fist with the thumb in
+// replaces the menu button on gloves that don't have one wired (a key is sent if either the
+// button or the gesture is pressed): {EncodedInput::Type::MENU, {1, 1, 1, 1, 1}, 800, 700, 250},
+#define CUSTOM_GESTURE_RULES
+
 // Force Feedback and haptic settings
 // Force feedback allows you to feel the solid objects you hold
 // Haptics provide vibration.
@@ -103,13 +219,17 @@
 #define GESTURE_COUNT        (TRIGGER_GESTURE + GRAB_GESTURE + PINCH_GESTURE)
 #define FINGER_COUNT         (ENABLE_THUMB ? 5 : 4)
 #define JOYSTICK_COUNT       (ENABLE_JOYSTICK ? 2 : 0)
+#define STICK_COUNT          (ENABLE_JOYSTICK ? 1 : 0)
 #define BUTTON_COUNT         (4 + ENABLE_JOYSTICK + !TRIGGER_GESTURE + !GRAB_GESTURE + !PINCH_GESTURE)
+#define IMU_COUNT            (ENABLE_IMU ? 1 : 0)
 // Ouputs
 #define HAPTIC_COUNT         (ENABLE_HAPTICS ? 1 : 0)
 #define FORCE_FEEDBACK_COUNT (ENABLE_FORCE_FEEDBACK ? FINGER_COUNT : 0)
 // Used for array allocations.
-#define MAX_INPUT_COUNT      (BUTTON_COUNT+FINGER_COUNT+JOYSTICK_COUNT+GESTURE_COUNT)
-#define MAX_CALIBRATED_COUNT FINGER_COUNT
+#define HAND_COUNT           (ENABLE_DUAL_HAND ? 2 : 1)
+#define MAX_INPUT_COUNT      (BUTTON_COUNT+FINGER_COUNT+JOYSTICK_COUNT+GESTURE_COUNT+IMU_COUNT)
+#define MAX_CALIBRATED_COUNT (FINGER_COUNT+STICK_COUNT)
+#define CHANNEL_STORE_SIZE   (FINGER_COUNT * (ENABLE_SPLAY ? 2 : 1) * HAND_COUNT)
 #define MAX_OUTPUT_COUNT     (HAPTIC_COUNT + FORCE_FEEDBACK_COUNT)
 
 //PINS CONFIGURATION
@@ -142,6 +262,11 @@
   #define PIN_MIDDLE_SPLAY    1
   #define PIN_INDEX_SPLAY     1
   #define PIN_THUMB_SPLAY     1
+  #define PIN_ADC_CS          10 //external ADC
+  #define PIN_ADC_SCK         13 //^ fixed hardware SPI pins, move the buttons on them to use the external ADC
+  #define PIN_ADC_MISO        12 //^
+  #define PIN_ADC_MOSI        11 //^
+                                 //the IMU uses the hardware I2C pins A4 and A5
 #elif defined(ESP32)
   //(This configuration is for ESP32 DOIT V1 so make sure to change if you're on another board)
   #define PIN_PINKY           36
@@ -171,6 +296,44 @@
   #define PIN_MIDDLE_SPLAY    1
   #define PIN_INDEX_SPLAY     1
   #define PIN_THUMB_SPLAY     1
+  #define PIN_ADC_CS          15 //external ADC
+  #define PIN_ADC_SCK         22 //^
+  #define PIN_ADC_MISO        4  //^
+  #define PIN_ADC_MOSI        16 //^
+  #define PIN_IMU_SDA         21 //IMU, on the index and thumb FFB pins so it can't be used with force feedback
+  #define PIN_IMU_SCL         17 //^
+
+  //Second hand with ENABLE_DUAL_HAND, the analog inputs are read from the external ADC
+  //(There are not enough free pins on the DOIT V1 for a complete second hand, change these to fit your board.
+  //Its buttons use the first hand's grab and pinch button and force feedback pins, which are free with the
+  //default gestures and without force feedback. Pins set to -1 have no free pin left, set them before enabling
+  //what uses them.)
+  #define PIN_PINKY_2         EXTERNAL_ADC_PIN(0)
+  #define PIN_RING_2          EXTERNAL_ADC_PIN(1)
+  #define PIN_MIDDLE_2        EXTERNAL_ADC_PIN(2)
+  #define PIN_INDEX_2         EXTERNAL_ADC_PIN(3)
+  #define PIN_THUMB_2         EXTERNAL_ADC_PIN(4)
+  #define PIN_JOY_X_2         EXTERNAL_ADC_PIN(5)
+  #define PIN_JOY_Y_2         EXTERNAL_ADC_PIN(6)
+  #define PIN_JOY_BTN_2       13
+  #define PIN_A_BTN_2         23
+  #define PIN_B_BTN_2         5
+  #define PIN_MENU_BTN_2      18
+  #define PIN_TRIG_BTN_2      -1 //unused if gesture set
+  #define PIN_GRAB_BTN_2      -1 //unused if gesture set
+  #define PIN_PNCH_BTN_2      -1 //unused if gesture set
+  #define PIN_CALIB_2         19 //button for recalibration
+  #define PIN_PINKY_FFB_2     -1 //used for force feedback
+  #define PIN_RING_FFB_2      -1 //^
+  #define PIN_MIDDLE_FFB_2    -1 //^
+  #define PIN_INDEX_FFB_2     -1 //^
+  #define PIN_THUMB_FFB_2     -1 //^
+  #define PIN_HAPTIC_2        -1
+  #define PIN_PINKY_SPLAY_2   EXTERNAL_ADC_PIN(7)
+  #define PIN_RING_SPLAY_2    EXTERNAL_ADC_PIN(7)
+  #define PIN_MIDDLE_SPLAY_2  EXTERNAL_ADC_PIN(7)
+  #define PIN_INDEX_SPLAY_2   EXTERNAL_ADC_PIN(7)
+  #define PIN_THUMB_SPLAY_2   EXTERNAL_ADC_PIN(7)
 #endif
 
 // You must install RunningMedian library to use this feature
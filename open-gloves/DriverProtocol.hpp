@@ -16,13 +16,17 @@ struct EncodedInput {
     GRAB = 'L',
     PINCH = 'M',
     MENU = 'N',
-    CALIBRATE = 'O'
+    CALIBRATE = 'O',
+    ORIENTATION = 'W' // Sent bracketed, see IMU.hpp.
   };
 
 
   // Setup any hardware needed for the input here.
   virtual void setupInput() {};
 
+  // The key this input is encoded with.
+  virtual Type getType() const = 0;
+
   // Get the maximum size of the encoded string this input
   // produces
   virtual int getEncodedSize() const = 0;
@@ -30,6 +34,15 @@ struct EncodedInput {
   // Encode the input to a strin the driver can understand.
   virtual int encode(char* output) const = 0;
 
+  // Inputs with a fixed layout (key followed by fixed width digits) can
+  // write their skeleton once, then only patch the digits every loop.
+  // Returns the size of the skeleton, or 0 if the input has a variable
+  // layout and must be encoded with encode() instead.
+  virtual int encodeTemplate(char* output) const { return 0; }
+
+  // Overwrite the digit fields of a skeleton written by encodeTemplate().
+  virtual void patchTemplate(char* output) const {}
+
   // Update internal data from any sensors or whatever the
   // input represents. This should be called every loop.
   virtual void readInput() = 0;
@@ -60,6 +73,103 @@ struct DecodedOuput {
   virtual void updateOutput() = 0;
 };
 
+// Two digit lookup used to convert integers to ASCII two digits at a time.
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809" "10111213141516171819"
+  "20212223242526272829" "30313233343536373839"
+  "40414243444546474849" "50515253545556575859"
+  "60616263646566676869" "70717273747576777879"
+  "80818283848586878889" "90919293949596979899";
+
+// Write value as a zero padded decimal of exactly width digits. Values
+// outside of the representable range are clamped. The driver parses "A0042"
+// the same as "A42", so fixed width fields are wire compatible.
+template<typename T>
+inline void encodeUnsignedDigits(char* output, T v, int width) {
+  char* end = output + width;
+  while (end - output >= 2) {
+    unsigned int pair = (v % 100) * 2;
+    v /= 100;
+    *--end = DIGIT_PAIRS[pair + 1];
+    *--end = DIGIT_PAIRS[pair];
+  }
+  if (end != output) {
+    *--end = '0' + (v % 10);
+    v /= 10;
+  }
+  // Overflowed the field, saturate to all nines.
+  if (v != 0) memset(output, '9', width);
+}
+
+inline void encodeDigits(char* output, int value, int width) {
+  if (value < 0) value = 0;
+  encodeUnsignedDigits<unsigned int>(output, value, width);
+}
+
+// Timestamps, which don't fit an int on every board.
+inline void encodeDigits(char* output, unsigned long value, int width) {
+  encodeUnsignedDigits<unsigned long>(output, value, width);
+}
+
+// Precomputed frame with all keys and separators already in place. Fixed width
+// inputs are packed at the front of the frame and only have their digits
+// patched each loop, variable inputs (buttons, gestures) are appended after
+// them followed by the newline.
+class FrameTemplate {
+ public:
+  FrameTemplate() : fixed(nullptr), offsets(nullptr), fixed_count(0), fixed_size(0),
+                    variable(nullptr), variable_count(0) {}
+
+  // Write the skeleton for the inputs to output, which must be large enough
+  // to hold getEncodedSize() of every input plus the newline and null terminator.
+  void build(char* output, EncodedInput* encoders[], size_t count) {
+    fixed = new EncodedInput*[count];
+    offsets = new int[count];
+    variable = new EncodedInput*[count];
+    fixed_count = variable_count = fixed_size = 0;
+
+    for (size_t i = 0; i < count; i++) {
+      int size = encoders[i]->encodeTemplate(output + fixed_size);
+      if (size > 0) {
+        fixed[fixed_count] = encoders[i];
+        offsets[fixed_count++] = fixed_size;
+        fixed_size += size;
+      } else {
+        variable[variable_count++] = encoders[i];
+      }
+    }
+
+    output[fixed_size] = '\n';
+    output[fixed_size + 1] = '\0';
+  }
+
+  // Encode the inputs into an output previously passed to build().
+  int encode(char* output) const {
+    for (size_t i = 0; i < fixed_count; i++) {
+      fixed[i]->patchTemplate(output + offsets[i]);
+    }
+
+    int offset = fixed_size;
+    for (size_t i = 0; i < variable_count; i++) {
+      offset += variable[i]->encode(output + offset);
+    }
+
+    // Add a new line to the end of the encoded string.
+    output[offset++] = '\n';
+    output[offset] = '\0';
+
+    return offset;
+  }
+
+ private:
+  EncodedInput** fixed;
+  int* offsets;
+  size_t fixed_count;
+  int fixed_size;
+  EncodedInput** variable;
+  size_t variable_count;
+};
+
 int encodeAll(char* output, EncodedInput* encoders[], size_t count) {
   int offset = 0;
   // Loop over all of the encoders and encode them to the output string.
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "Config.h"
+#include "ICommunication.hpp"
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+
+// Largest ESP-NOW payload.
+#define ESPNOW_MAX_PACKET 250
+// How many received packets can wait for readData().
+#define ESPNOW_RX_QUEUE 8
+
+// Peer to peer link to an ESP32 running the espnow-bridge firmware, which
+// forwards the frames to the PC over USB serial. There is no connection or
+// access point in between, so a frame only takes the air time of one packet.
+//
+// Every packet starts with a small header followed by text:
+//   uint8_t  magic     'G'
+//   uint8_t  hand      ESPNOW_HAND_LEFT or ESPNOW_HAND_RIGHT
+//   uint16_t sequence  Incremented for every packet, gaps mean lost packets.
+//   char     text[]    Frames longer than one packet are split over several.
+// Commands from the driver come back the same way, one line per packet. The
+// bridge answers the first packet with an empty one, after which the glove
+// sends to the bridge directly instead of ESPNOW_BRIDGE_ADDRESS.
+//
+// A dual hand board has one instance per hand. They share the radio, and the
+// acknowledgements don't say which hand's packet arrived, so the link state and
+// unacknowledged packets are shared as well.
+class ESPNowCommunication : public ICommunication {
+ public:
+  struct Header {
+    uint8_t magic;
+    uint8_t hand;
+    uint16_t sequence;
+  };
+
+  static constexpr uint8_t MAGIC = 'G';
+  static constexpr size_t MAX_TEXT = ESPNOW_MAX_PACKET - sizeof(Header);
+
+  ESPNowCommunication(uint8_t hand = ESPNOW_HAND) : hand(hand), sequence(0), last_received(0),
+                          receiving(false), lost_packets(0), failed_sends(0),
+                          bridge_known(false), rx_head(0), rx_tail(0), paired(false) {
+    instances[hand] = this;
+  }
+
+  void start() {
+    if (!started) {
+      Serial.begin(SERIAL_BAUD_RATE);
+
+      WiFi.mode(WIFI_STA);
+      WiFi.disconnect();
+      esp_wifi_set_channel(ESPNOW_CHANNEL, WIFI_SECOND_CHAN_NONE);
+      #if !ENABLE_POWER_SAVING
+        // Don't wait for the radio to wake up before sending.
+        esp_wifi_set_ps(WIFI_PS_NONE);
+      #endif
+
+      if (esp_now_init() != ESP_OK) {
+        Serial.println("ESP-NOW failed to start!");
+        return;
+      }
+      esp_now_register_send_cb(onSent);
+      esp_now_register_recv_cb(onReceive);
+      started = true;
+    }
+
+    const uint8_t address[] = ESPNOW_BRIDGE_ADDRESS;
+    addPeer(address);
+    esp_wifi_config_espnow_rate(WIFI_IF_STA, ESPNOW_PHY_RATE);
+
+    Serial.print("ESP-NOW started, this glove's address is ");
+    Serial.println(WiFi.macAddress());
+  }
+
+  // Open while the paired bridge acknowledged a packet recently.
+  bool isOpen() {
+    return has_ack && millis() - last_ack < ESPNOW_LINK_TIMEOUT;
+  }
+
+  void output(char* data) {
+    // Pair with the bridge once it answered. The other hand may still be
+    // looking for it at the old address.
+    if (!paired && bridge_known) {
+      ESPNowCommunication* other = instances[1 - hand];
+      if (other == nullptr || other->paired) esp_now_del_peer(peer);
+      addPeer((const uint8_t*)bridge);
+      paired = true;
+    }
+
+    size_t length = strlen(data);
+    uint8_t packet[ESPNOW_MAX_PACKET];
+    Header* header = reinterpret_cast<Header*>(packet);
+    header->magic = MAGIC;
+    header->hand = hand;
+
+    do {
+      size_t chunk = min(length, MAX_TEXT);
+      header->sequence = sequence++;
+      memcpy(packet + sizeof(Header), data, chunk);
+      // The driver's queue is full, the frame is lost.
+      if (esp_now_send(peer, packet, sizeof(Header) + chunk) != ESP_OK) failed_sends++;
+      data += chunk;
+      length -= chunk;
+    } while (length > 0);
+  }
+
+  bool hasData() {
+    return rx_tail != rx_head;
+  }
+
+  bool readData(char* input, size_t buffer_size) {
+    if (rx_tail == rx_head) {
+      input[0] = '\0';
+      return false;
+    }
+
+    volatile Received& received = rx_queue[rx_tail];
+    size_t size = min((size_t)received.length, buffer_size - 1);
+    memcpy(input, (const char*)received.text, size);
+    if (size > 0 && input[size - 1] == '\n') size--;
+    input[size] = '\0';
+    rx_tail = (rx_tail + 1) % ESPNOW_RX_QUEUE;
+    return size > 0;
+  }
+
+  // Packets from the bridge that never arrived.
+  uint32_t getLostPackets() const {
+    return lost_packets;
+  }
+
+  // Packets that couldn't be sent or weren't acknowledged.
+  uint32_t getFailedSends() const {
+    return failed_sends + unacknowledged;
+  }
+
+ private:
+  struct Received {
+    uint8_t length;
+    char text[MAX_TEXT];
+  };
+
+  void addPeer(const uint8_t* address) {
+    esp_now_peer_info_t info = {};
+    memcpy(info.peer_addr, address, ESP_NOW_ETH_ALEN);
+    info.channel = ESPNOW_CHANNEL;
+    info.ifidx = WIFI_IF_STA;
+    info.encrypt = false;
+    esp_now_add_peer(&info);
+    memcpy(peer, address, ESP_NOW_ETH_ALEN);
+  }
+
+  // Both callbacks run on the WiFi task.
+  static void onSent(const uint8_t* address, esp_now_send_status_t status) {
+    // Broadcasts aren't acknowledged, they report success once they were sent.
+    // Only packets to a bridge that answered count.
+    if (!isPairedPeer(address)) return;
+
+    if (status == ESP_NOW_SEND_SUCCESS) {
+      last_ack = millis();
+      has_ack = true;
+    } else {
+      unacknowledged++;
+    }
+  }
+
+  static bool isPairedPeer(const uint8_t* address) {
+    for (ESPNowCommunication* instance : instances) {
+      if (instance != nullptr && instance->paired &&
+          memcmp(instance->peer, address, ESP_NOW_ETH_ALEN) == 0) return true;
+    }
+    return false;
+  }
+
+  #if ESP_IDF_VERSION_MAJOR >= 5
+    static void onReceive(const esp_now_recv_info_t* info, const uint8_t* data, int length) {
+      dispatch(info->src_addr, data, length);
+    }
+  #else
+    static void onReceive(const uint8_t* address, const uint8_t* data, int length) {
+      dispatch(address, data, length);
+    }
+  #endif
+
+  static void dispatch(const uint8_t* address, const uint8_t* data, int length) {
+    if (length < (int)sizeof(Header) || data[1] > ESPNOW_HAND_RIGHT) return;
+    ESPNowCommunication* instance = instances[data[1]];
+    if (instance != nullptr) instance->receive(address, data, length);
+  }
+
+  void receive(const uint8_t* address, const uint8_t* data, int length) {
+    if (length < (int)sizeof(Header)) return;
+    Header header;
+    memcpy(&header, data, sizeof(Header));
+    if (header.magic != MAGIC || header.hand != hand) return;
+
+    // Count the packets missing between this one and the last.
+    if (receiving) lost_packets += (uint16_t)(header.sequence - last_received - 1);
+    last_received = header.sequence;
+    receiving = true;
+
+    if (!bridge_known) {
+      memcpy((uint8_t*)bridge, address, ESP_NOW_ETH_ALEN);
+      bridge_known = true;
+    }
+
+    // Empty packets only pair the bridge.
+    size_t text_length = length - sizeof(Header);
+    if (text_length == 0) return;
+
+    uint8_t next = (rx_head + 1) % ESPNOW_RX_QUEUE;
+    if (next == rx_tail) return;
+    rx_queue[rx_head].length = text_length;
+    memcpy((char*)rx_queue[rx_head].text, data + sizeof(Header), text_length);
+    rx_head = next;
+  }
+
+  static ESPNowCommunication* instances[2];
+  static bool started;
+
+  // Written by the WiFi task, shared by both hands.
+  static volatile uint32_t unacknowledged;
+  static volatile unsigned long last_ack;
+  static volatile bool has_ack;
+
+  const uint8_t hand;
+  uint8_t peer[ESP_NOW_ETH_ALEN];
+  uint16_t sequence;
+
+  // Written by the WiFi task.
+  volatile uint16_t last_received;
+  volatile bool receiving;
+  volatile uint32_t lost_packets;
+  uint32_t failed_sends;
+  volatile uint8_t bridge[ESP_NOW_ETH_ALEN];
+  volatile bool bridge_known;
+
+  // Single producer (WiFi task) single consumer (loop) queue.
+  volatile Received rx_queue[ESPNOW_RX_QUEUE];
+  volatile uint8_t rx_head;
+  volatile uint8_t rx_tail;
+
+  // Read by the WiFi task.
+  volatile bool paired;
+};
+
+ESPNowCommunication* ESPNowCommunication::instances[2] = {nullptr, nullptr};
+bool ESPNowCommunication::started = false;
+volatile uint32_t ESPNowCommunication::unacknowledged = 0;
+volatile unsigned long ESPNowCommunication::last_ack = 0;
+volatile bool ESPNowCommunication::has_ack = false;
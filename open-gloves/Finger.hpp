@@ -3,7 +3,11 @@
 #include "Config.h"
 
 #include "Calibration.hpp"
+#include "ChannelStore.hpp"
 #include "DriverProtocol.hpp"
+#include "LoopBudget.hpp"
+#include "SampleTrace.hpp"
+#include "Settings.hpp"
 
 #if ENABLE_MEDIAN_FILTER
   #include <RunningMedian.h>
@@ -12,59 +16,140 @@
 class Finger : public EncodedInput, public Calibrated {
  public:
   Finger(EncodedInput::Type enc_type, int pin) :
-    type(enc_type), pin(pin), value(0),
-    median(MEDIAN_SAMPLES) {}
+    type(enc_type), pin(pin), value(0), raw_value(0),
+    median(MEDIAN_SAMPLES) {
+    #if ENABLE_CHANNEL_STORE
+      channel = channel_store.add(ChannelStore::CURL);
+    #else
+      // Every finger keeps its curve points in its own slot of the settings.
+      points_slot = next_points_slot++;
+    #endif
+  }
 
   void readInput() override {
     // Read the latest value.
-    int new_value = analogRead(pin);
+    int new_value = SampleTrace::analog(pin);
 
     // Apply configured modifiers.
-    #if INVERT_CURL
+    if (settings.invert_curl) {
       new_value = ANALOG_MAX - new_value;
-    #endif
+    }
 
     #if ENABLE_MEDIAN_FILTER
-      median.add(new_value);
-      new_value = median.getMedian();
+      if (settings.median_filter && LoopBudget::filtersEnabled()) {
+        median.add(new_value);
+        new_value = median.getMedian();
+      }
     #endif
 
-    // Update the calibration
-    if (calibrate) {
-      calibrator.update(new_value);
-    }
+    raw_value = new_value;
+
+    #if ENABLE_CHANNEL_STORE
+      // Calibrated with all the other channels when the value is needed.
+      channel_store.setRaw(channel, new_value);
+    #else
+      // Update the calibration
+      if (calibrate) {
+        calibrator.update(new_value);
+      }
+
+      // set the value to the calibrated value.
+      value = calibrator.calibrate(new_value);
+    #endif
+  }
 
-    // set the value to the calibrated value.
-    value = calibrator.calibrate(new_value);
+  EncodedInput::Type getType() const override {
+    return type;
   }
 
   inline int getEncodedSize() const override {
     // Encode string size = AXXXX + '\0'
-    return 6;
+    return 1 + ENCODED_VALUE_DIGITS + 1;
   }
 
   int encode(char* output) const override {
-    return snprintf(output, getEncodedSize(), "%c%d", type, value);
+    return snprintf(output, getEncodedSize(), "%c%d", type, curlValue());
+  }
+
+  int encodeTemplate(char* output) const override {
+    // Template = A + digits
+    output[0] = type;
+    patchTemplate(output);
+    return 1 + ENCODED_VALUE_DIGITS;
+  }
+
+  void patchTemplate(char* output) const override {
+    encodeDigits(output + 1, curlValue(), ENCODED_VALUE_DIGITS);
   }
 
   void resetCalibration() override {
-    calibrator.reset();
+    #if ENABLE_CHANNEL_STORE
+      channel_store.reset(channel);
+    #else
+      calibrator.reset();
+    #endif
   }
 
+  #if !ENABLE_CHANNEL_STORE
+    void loadCalibration() override {
+      for (int i = 0; i < CALIBRATION_CURL::POINTS; i++) {
+        calibrator.setPoint(i, settings.curl_points[points_slot][i]);
+      }
+    }
+
+    void capturePoint(int index) override {
+      if (index < 0 || index >= CALIBRATION_CURL::POINTS) return;
+      settings.curl_points[points_slot][index] = raw_value;
+      calibrator.setPoint(index, raw_value);
+    }
+
+    void clearPoints() override {
+      for (int i = 0; i < CALIBRATION_CURL::POINTS; i++) {
+        settings.curl_points[points_slot][i] = -1;
+      }
+      loadCalibration();
+    }
+  #endif
+
+  #if ENABLE_CHANNEL_STORE
+    void enableCalibration() override {
+      Calibrated::enableCalibration();
+      channel_store.setCalibrating(channel, true);
+    }
+
+    void disableCalibration() override {
+      Calibrated::disableCalibration();
+      channel_store.setCalibrating(channel, false);
+    }
+  #endif
+
   virtual int flexionValue() const {
-    return value;
+    return curlValue();
   }
 
   // Allow others access to the finger's calibrator so they can
   // map other values on this range.
   int mapOntoCalibratedRange(int input, int min, int max) const {
-    return calibrator.calibrate(input);
+    #if ENABLE_CHANNEL_STORE
+      return channel_store.calibrate(channel, input);
+    #else
+      return calibrator.calibrate(input);
+    #endif
   }
 
  protected:
+  inline int curlValue() const {
+    #if ENABLE_CHANNEL_STORE
+      return channel_store.output(channel);
+    #else
+      return value;
+    #endif
+  }
+
   EncodedInput::Type type;
   int pin;
   int value;
+  int raw_value; // After inverting and filtering, as the calibrator sees it.
 
   #if ENABLE_MEDIAN_FILTER
     RunningMedian median;
@@ -72,41 +157,108 @@ class Finger : public EncodedInput, public Calibrated {
     int median;
   #endif
 
-  CALIBRATION_CURL calibrator;
+  #if ENABLE_CHANNEL_STORE
+    int channel;
+  #else
+    CALIBRATION_CURL calibrator;
+    int points_slot;
+    static int next_points_slot;
+  #endif
 };
 
+#if !ENABLE_CHANNEL_STORE
+  int Finger::next_points_slot = 0;
+#endif
+
 class SplayFinger : public Finger {
  public:
   SplayFinger(EncodedInput::Type enc_type, int pin, int splay_pin) :
-    Finger(enc_type, pin), splay_pin(splay_pin), splay_value(0) {}
+    Finger(enc_type, pin), splay_pin(splay_pin), splay_value(0) {
+    #if ENABLE_CHANNEL_STORE
+      splay_channel = channel_store.add(ChannelStore::SPLAY);
+    #endif
+  }
 
   void readInput() override {
     Finger::readInput();
-    int new_splay_value = analogRead(splay_pin);
-    // Update the calibration
-    if (calibrate) {
-      splay_calibrator.update(new_splay_value);
+
+    // Splay can be sampled less often when the loop is over budget.
+    if (!LoopBudget::sampleSecondary()) return;
+
+    int new_splay_value = SampleTrace::analog(splay_pin);
+    if (settings.invert_splay) {
+      new_splay_value = ANALOG_MAX - new_splay_value;
     }
 
-    // set the value to the calibrated value.
-    splay_value = splay_calibrator.calibrate(new_splay_value);
+    #if ENABLE_CHANNEL_STORE
+      channel_store.setRaw(splay_channel, new_splay_value);
+    #else
+      // Update the calibration
+      if (calibrate) {
+        splay_calibrator.update(new_splay_value);
+      }
+
+      // set the value to the calibrated value.
+      splay_value = splay_calibrator.calibrate(new_splay_value);
+    #endif
   }
 
   inline int getEncodedSize() const override {
     // Encoded string size = AXXXX(AB)XXXX + '\0'
-    return 14;
+    return 1 + ENCODED_VALUE_DIGITS + 4 + ENCODED_VALUE_DIGITS + 1;
   }
 
   int encode(char* output) const override {
-    return snprintf(output, getEncodedSize(), "%c%d(%cB)%d", type, value, type, splay_value);
+    return snprintf(output, getEncodedSize(), "%c%d(%cB)%d", type, curlValue(), type, splayValue());
   }
 
+  int encodeTemplate(char* output) const override {
+    // Template = A + digits + (AB) + digits
+    int offset = Finger::encodeTemplate(output);
+    output[offset++] = '(';
+    output[offset++] = type;
+    output[offset++] = 'B';
+    output[offset++] = ')';
+    encodeDigits(output + offset, splayValue(), ENCODED_VALUE_DIGITS);
+    return offset + ENCODED_VALUE_DIGITS;
+  }
+
+  void patchTemplate(char* output) const override {
+    Finger::patchTemplate(output);
+    encodeDigits(output + 1 + ENCODED_VALUE_DIGITS + 4, splayValue(), ENCODED_VALUE_DIGITS);
+  }
+
+  #if ENABLE_CHANNEL_STORE
+    void resetCalibration() override {
+      Finger::resetCalibration();
+      channel_store.reset(splay_channel);
+    }
+
+    void enableCalibration() override {
+      Finger::enableCalibration();
+      channel_store.setCalibrating(splay_channel, true);
+    }
+
+    void disableCalibration() override {
+      Finger::disableCalibration();
+      channel_store.setCalibrating(splay_channel, false);
+    }
+  #endif
+
   virtual int splayValue() const {
-    return splay_value;
+    #if ENABLE_CHANNEL_STORE
+      return channel_store.output(splay_channel);
+    #else
+      return splay_value;
+    #endif
   }
 
  protected:
   int splay_pin;
   int splay_value;
-  CALIBRATION_SPLAY splay_calibrator;
+  #if ENABLE_CHANNEL_STORE
+    int splay_channel;
+  #else
+    CALIBRATION_SPLAY splay_calibrator;
+  #endif
 };
@@ -2,6 +2,7 @@
 
 #include "DriverProtocol.hpp"
 #include "Finger.hpp"
+#include "Settings.hpp"
 
 #if defined(ESP32)
   #include <ESP32Servo.h>
@@ -24,7 +25,7 @@ class ForceFeedback : public DecodedOuput {
   ForceFeedback(DecodedOuput::Type type, const Finger* finger) : type(type), finger(finger), limit(0) {}
 
   void decodeToOuput(const char* input) override {
-    char* start = strchr(input, type);
+    const char* start = strchr(input, type);
     if (start != NULL) {
       limit = atoi(start + 1);
     }
@@ -60,7 +61,7 @@ class ServoForceFeedback : public ForceFeedback {
     #if FORCE_FEEDBACK_FINGER_SCALING
       // TODO: Does this actually scale correctly?
       // Map the Limit to the range of motion that the finger has been through.
-      int out = finger->mapOntoCalibratedRange(input_limit, FORCE_FEEDBACK_MIN, FORCE_FEEDBACK_MAX);
+      int out = finger->mapOntoCalibratedRange(input_limit, settings.ffb_min, settings.ffb_max);
 
       // Map that range onto the servo's output range.
       out = accurateMap(out, 0, ANALOG_MAX, SERVO_MIN, SERVO_MAX);
@@ -69,7 +70,7 @@ class ServoForceFeedback : public ForceFeedback {
       return constrain(out, SERVO_MIN, SERVO_MAX);
     #else
       // Use the entire range of motion.
-      return accurateMap(input_limit, FORCE_FEEDBACK_MIN, FORCE_FEEDBACK_MAX, SERVO_MIN, SERVO_MAX);;
+      return accurateMap(input_limit, settings.ffb_min, settings.ffb_max, SERVO_MIN, SERVO_MAX);;
     #endif
   }
 
@@ -86,12 +87,12 @@ class ClampForceFeedback : public ForceFeedback {
   void updateOutput() override {
     // Since the higher the limit, the less the finger should be able to move, map the finger's position onto
     // the flipped range.
-    int relative_finger_position = map(finger->flexionValue(), ANALOG_MAX, 0, FORCE_FEEDBACK_MIN, FORCE_FEEDBACK_MAX);
+    int relative_finger_position = map(finger->flexionValue(), ANALOG_MAX, 0, settings.ffb_min, settings.ffb_max);
 
     // Lock or unlock the clamp if the finger is at the limit.
     // Unlock the finger if the user goes too far passed. This means they have
     // overcome the brake, we release to prevent damage to the system.
-    if (relative_finger_position < limit && relative_finger_position >= limit - FORCE_FEEDBACK_RELEASE) lock();
+    if (relative_finger_position < limit && relative_finger_position >= limit - settings.ffb_release) lock();
     else unlock();
   }
 
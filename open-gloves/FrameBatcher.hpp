@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Config.h"
+
+#include "DriverProtocol.hpp"
+
+// Collects several encoded frames into one transmission so slow links (eg.
+// bluetooth SPP) only pay the framing and flush overhead once per batch while
+// the inputs keep being sampled at BATCH_SAMPLE_PERIOD.
+//
+// Each sample is a complete frame with a "(T)" key appended that holds the time
+// in microseconds since the first sample of the batch, so the driver can spread
+// the samples back out over time:
+//   A0123B0456...(T)00000\n
+//   A0125B0460...(T)01000\n
+//
+// The number of samples per batch adapts to the link. If sending a batch took
+// longer than the time it covers, the link can't keep up and the batch grows.
+// When there is plenty of headroom it shrinks again to reduce latency.
+class FrameBatcher {
+ public:
+  static constexpr int TIMESTAMP_SIZE = 3 + 5; // (T) + digits
+
+  FrameBatcher() : buffer(nullptr), frame_size(0), used(0), samples(0),
+                   batch_size(1), batch_start(0) {}
+
+  // frame_size is the maximum size of a single encoded frame, including the newline.
+  void setup(int max_frame_size) {
+    frame_size = max_frame_size + TIMESTAMP_SIZE;
+    buffer = new char[frame_size * BATCH_MAX_SAMPLES + 1];
+    buffer[0] = '\0';
+  }
+
+  // Add a newline terminated frame to the batch. Returns true once the batch is
+  // full and should be sent, with at least min_samples in it.
+  bool add(const char* frame, int length, unsigned long sample_time, int min_samples = 1) {
+    if (samples == 0) {
+      used = 0;
+      batch_start = sample_time;
+    }
+
+    // Copy the frame without its newline then append the timestamp.
+    memcpy(buffer + used, frame, length - 1);
+    used += length - 1;
+    memcpy(buffer + used, "(T)", 3);
+    encodeDigits(buffer + used + 3, sample_time - batch_start, 5);
+    used += TIMESTAMP_SIZE;
+    buffer[used++] = '\n';
+    buffer[used] = '\0';
+
+    return ++samples >= max(batch_size, min(min_samples, BATCH_MAX_SAMPLES));
+  }
+
+  // Report how long sending the batch took so the batch size can adapt.
+  void sent(unsigned long send_time) {
+    unsigned long covered = (unsigned long)samples * BATCH_SAMPLE_PERIOD;
+    if (send_time > covered && batch_size < BATCH_MAX_SAMPLES) {
+      batch_size++;
+    } else if (send_time < covered / 4 && batch_size > 1) {
+      batch_size--;
+    }
+    samples = 0;
+  }
+
+  char* data() {
+    return buffer;
+  }
+
+  int getBatchSize() const {
+    return batch_size;
+  }
+
+ private:
+  char* buffer;
+  int frame_size;
+  int used;
+  int samples;
+  int batch_size;
+  unsigned long batch_start;
+};
@@ -9,6 +9,10 @@ class Gesture : public EncodedInput {
  public:
   Gesture(EncodedInput::Type type) : type(type), value(false) {}
 
+  EncodedInput::Type getType() const override {
+    return type;
+  }
+
   inline int getEncodedSize() const override {
    // Encode string size = single char or '\0'
     return 1;
@@ -28,54 +32,103 @@ class Gesture : public EncodedInput {
   bool value;
 };
 
-class GrabGesture : public Gesture {
- public:
-  GrabGesture(const Finger* index, const Finger* middle,
-              const Finger* ring, const Finger* pinky) :
-    Gesture(EncodedInput::Type::GRAB),
-    index(index), middle(middle), ring(ring), pinky(pinky)  {}
-
-  // Grab gesture is pressed if the average all fingers is more than
-  // halfway flexed.
-  void readInput() override {
-    value = (index->flexionValue() + middle->flexionValue() +
-             ring->flexionValue() + pinky->flexionValue()) / 4 > ANALOG_MAX / 2;
-  }
-
- private:
-   const Finger* index;
-   const Finger* middle;
-   const Finger* ring;
-   const Finger* pinky;
+// A gesture defined by data instead of code (See the gesture rules in Config.h).
+// The gesture is pressed when the weighted average flexion of its fingers goes
+// above the press threshold, and released when it drops below the release
+// threshold. A change only takes effect once it has held for hold_ms.
+struct GestureRule {
+  EncodedInput::Type type;
+  uint8_t weights[5]; // Thumb, index, middle, ring, pinky.
+  int16_t press;      // Per mille of the flexion range.
+  int16_t release;    // Per mille of the flexion range.
+  uint16_t hold_ms;
 };
 
-class TriggerGesture : public Gesture {
+class RuleGesture : public Gesture {
  public:
-  TriggerGesture(const Finger* index_finger) :
-    Gesture(EncodedInput::Type::TRIGGER), index_finger(index_finger) {}
+  // hand holds the thumb, index, middle, ring and pinky in that order,
+  // the thumb may be NULL.
+  RuleGesture(const GestureRule& rule, Finger* const hand[5]) :
+    Gesture(rule.type), rule(rule), hand(hand), finger_count(0),
+    press(0), release(0), pending_since(0), pending(false) {}
+
+  // Compile the rule into the fingers it uses with fixed point weights and
+  // thresholds in raw units, so evaluating it is a short multiply-add.
+  void setupInput() override {
+    int total = 0;
+    for (int i = 0; i < 5; i++) {
+      if (hand[i] != NULL) total += rule.weights[i];
+    }
+
+    finger_count = 0;
+    for (int i = 0; i < 5 && total > 0; i++) {
+      if (hand[i] == NULL || rule.weights[i] == 0) continue;
+      fingers[finger_count] = hand[i];
+      weights[finger_count] = (rule.weights[i] * 256 + total / 2) / total;
+      last_values[finger_count] = -1;
+      finger_count++;
+    }
+
+    press = (long)rule.press * ANALOG_MAX / 1000;
+    release = (long)rule.release * ANALOG_MAX / 1000;
+  }
 
-  // Trigger gesture is pressed if the index finger is more than halfway flexed
   void readInput() override {
-    value = index_finger->flexionValue() > ANALOG_MAX / 2;
+    // Only evaluate when one of the fingers moved, or a change is waiting
+    // for its hold time.
+    bool changed = false;
+    for (int i = 0; i < finger_count; i++) {
+      int finger_value = fingers[i]->flexionValue();
+      if (finger_value != last_values[i]) {
+        last_values[i] = finger_value;
+        changed = true;
+      }
+    }
+    if (!changed && !pending) return;
+
+    int32_t flexion = 0;
+    for (int i = 0; i < finger_count; i++) {
+      flexion += (int32_t)last_values[i] * weights[i];
+    }
+    flexion >>= 8;
+
+    // Hysteresis, a pressed gesture needs to drop below the release threshold.
+    bool target = value ? flexion > release : flexion >= press;
+    if (target == value) {
+      pending = false;
+      return;
+    }
+
+    unsigned long now = millis();
+    if (!pending) {
+      pending = true;
+      pending_since = now;
+    }
+    if (now - pending_since >= rule.hold_ms) {
+      value = target;
+      pending = false;
+    }
   }
 
  private:
-   const Finger* index_finger;
+  const GestureRule rule;
+  Finger* const* hand;
+
+  const Finger* fingers[5];
+  int16_t weights[5];
+  int last_values[5];
+  int finger_count;
+
+  int press;
+  int release;
+  unsigned long pending_since;
+  bool pending;
 };
 
-class PinchGesture : public Gesture {
- public:
-  PinchGesture(const Finger* thumb, const Finger* index_finger) :
-    Gesture(EncodedInput::Type::PINCH), thumb(thumb), index_finger(index_finger) {}
-
-  // Pinch gesture is pressed if the average flex of the thumb and index is more than
-  // halfway flexed.
-  void readInput() override {
-    // TODO: Do we need to divide both values here?
-    value = (thumb->flexionValue() + index_finger->flexionValue()) / 2 > ANALOG_MAX / 2;
+Gesture** createRuleGestures(const GestureRule rules[], size_t count, Finger* const hand[5]) {
+  Gesture** gestures = new Gesture*[count];
+  for (size_t i = 0; i < count; i++) {
+    gestures[i] = new RuleGesture(rules[i], hand);
   }
-
-  private:
-   const Finger* thumb;
-   const Finger* index_finger;
-};
+  return gestures;
+}
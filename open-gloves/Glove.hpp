@@ -0,0 +1,335 @@
+#pragma once
+
+#include "Config.h"
+
+#include "Button.hpp"
+#include "Calibration.hpp"
+#include "DriverProtocol.hpp"
+#include "FrameBatcher.hpp"
+#include "Handshake.hpp"
+#include "ICommunication.hpp"
+#include "JoyStick.hpp"
+#include "LoopBudget.hpp"
+#include "SampleTrace.hpp"
+#include "Settings.hpp"
+#include "Telemetry.hpp"
+
+#define ALWAYS_CALIBRATING (settings.calibration_loops == -1)
+
+// Everything that makes up one hand: its inputs, outputs and calibrators, and
+// the connection to the driver that carries its frames.
+//
+// The main loop runs each stage for every glove before moving on to the next,
+// so with ENABLE_DUAL_HAND both hands are sampled in the same acquisition pass
+// and sent in the same loop, at the same rate as a single glove.
+class Glove {
+ public:
+  Glove(ICommunication* comm, Button* calibration_button, size_t max_inputs) :
+    comm(comm), calibration_button(calibration_button), inputs(new EncodedInput*[max_inputs]),
+    input_count(0), output_count(0), calibrated_count(0),
+    encoded_output_string(nullptr), calibration_count(0), comm_open(false) {}
+
+  template<typename T>
+  void addInputs(T* const source[], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      inputs[input_count++] = source[i];
+    }
+  }
+
+  template<typename T>
+  void addOutputs(T* const source[], size_t count) {
+    #if MAX_OUTPUT_COUNT > 0
+      for (size_t i = 0; i < count; i++) {
+        outputs[output_count++] = source[i];
+      }
+    #endif
+  }
+
+  template<typename T>
+  void addCalibrated(T* const source[], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      calibrators[calibrated_count++] = source[i];
+    }
+  }
+
+  // Call once all the inputs and outputs were added.
+  void setup() {
+    // Figure out needed size for the output string.
+    int string_size = 0;
+    for(size_t i = 0; i < input_count; i++) {
+      string_size += inputs[i]->getEncodedSize();
+    }
+
+    #if ENABLE_TELEMETRY
+      string_size += LinkTelemetry::TRAILER_SIZE;
+    #endif
+
+    // Add 1 for new line and 1 for the null terminator.
+    encoded_output_string = new char[string_size + 1 + 1];
+
+    #if ENABLE_BATCHING
+      batcher.setup(string_size + 1);
+    #endif
+
+    // Setup all the inputs.
+    for (size_t i = 0; i < input_count; i++) {
+      inputs[i]->setupInput();
+    }
+
+    #if ENABLE_FIXED_WIDTH_ENCODING
+      // The layout of the frame is fixed now that all inputs are registered.
+      frame_template.build(encoded_output_string, inputs, input_count);
+    #endif
+
+    // Setup all the outputs.
+    #if MAX_OUTPUT_COUNT > 0
+      for (size_t i = 0; i < output_count; i++) {
+        outputs[i]->setupOutput();
+      }
+    #endif
+
+    if (ALWAYS_CALIBRATING) {
+      for (size_t i = 0; i < calibrated_count; i++) {
+        calibrators[i]->enableCalibration();
+      }
+    }
+  }
+
+  // Check the connection and step the calibration, once per loop.
+  void update(bool settings_changed) {
+    comm_open = comm->isOpen();
+    handshake.update(comm, comm_open, inputs, input_count);
+
+    // Notify the calibrators to turn on. Only reset once per press so a held
+    // or bouncing button doesn't restart the calibration repeatedly.
+    if (calibration_button->pressedThisFrame()) {
+      calibration_count = 0;
+      for (size_t i = 0; i < calibrated_count; i++) {
+        calibrators[i]->resetCalibration();
+        calibrators[i]->enableCalibration();
+      }
+    }
+
+    if (settings_changed) {
+      // The stored calibration may have been changed or restored.
+      for (size_t i = 0; i < calibrated_count; i++) {
+        calibrators[i]->loadCalibration();
+      }
+      // Calibration may have been switched to always on at runtime.
+      if (ALWAYS_CALIBRATING) {
+        for (size_t i = 0; i < calibrated_count; i++) {
+          calibrators[i]->enableCalibration();
+        }
+      }
+    }
+
+    if (calibration_count < settings.calibration_loops || ALWAYS_CALIBRATING) {
+      // Keep calibrating for one at least one more loop.
+      calibration_count++;
+    } else {
+      // Calibration is done, notify the calibrators
+      for (size_t i = 0; i < calibrated_count; i++) {
+        calibrators[i]->disableCalibration();
+      }
+    }
+  }
+
+  void readInputs() {
+    for (size_t i = 0; i < input_count; i++) {
+      inputs[i]->readInput();
+    }
+  }
+
+  // Encode and send the inputs, then apply any commands that came back. The
+  // sample time is only needed for the telemetry and batching.
+  #if ENABLE_TELEMETRY || ENABLE_BATCHING
+    void sendFrame(unsigned long sample_time) {
+  #else
+    void sendFrame(unsigned long) {
+  #endif
+    // The frame template is overwritten by the other encodings, rebuild it if
+    // the driver switched back to it.
+    #if ENABLE_FIXED_WIDTH_ENCODING
+      if (handshake.optionsChanged() && handshake.uses(Handshake::FIXED_WIDTH)) {
+        frame_template.build(encoded_output_string, inputs, input_count);
+      }
+    #endif
+
+    // A frame the loop budget holds back isn't encoded at all. When batching
+    // every sample goes into the batch, the batcher decides when to send.
+    bool send_frame = LoopBudget::sendOutput();
+    #if ENABLE_BATCHING
+      send_frame = send_frame || handshake.uses(Handshake::BATCHED);
+    #endif
+    if (!send_frame) {
+      readCommands(false);
+      return;
+    }
+
+    // Encode all of the inputs to a single string.
+    #if ENABLE_TELEMETRY || ENABLE_BATCHING
+      int encoded_length = encode();
+    #else
+      encode();
+    #endif
+
+    #if ENABLE_TELEMETRY
+      if (handshake.uses(Handshake::TELEMETRY)) {
+        encoded_length = telemetry.appendTrailer(encoded_output_string, encoded_length, sample_time);
+      }
+    #endif
+
+    #if ENABLE_BATCHING
+      // Only send once enough samples have been collected.
+      if (handshake.uses(Handshake::BATCHED)) {
+        send_frame = batcher.add(encoded_output_string, encoded_length, sample_time,
+                                 LoopBudget::minBatchSamples());
+      }
+    #endif
+
+    if (send_frame) {
+      // Send the string to the communication handler.
+      #if ENABLE_BATCHING
+        if (handshake.uses(Handshake::BATCHED)) {
+          unsigned long send_start = micros();
+          comm->output(batcher.data());
+          batcher.sent(micros() - send_start);
+        } else
+      #endif
+      {
+        comm->output(encoded_output_string);
+      }
+
+      #if ENABLE_TELEMETRY
+        if (handshake.uses(Handshake::TELEMETRY)) {
+          telemetry.update(comm);
+        }
+      #endif
+    }
+
+    // Commands keep coming while frames are held back, but only wait for an
+    // answer to a frame that was sent.
+    readCommands(ENABLE_SYNCHRONOUS_COMM && send_frame);
+  }
+
+  // Commands that aren't about one hand, they must only be applied once even
+  // when they reach both hands (See HandMultiplexer.hpp).
+  static bool handleGlobal(ICommunication* comm, const char* input) {
+    return Settings::handle(comm, input)
+      #if ENABLE_RECORDING
+        || SampleTrace::handle(comm, input)
+      #endif
+      ;
+  }
+
+  // Allow all the outputs to update their state.
+  void updateOutputs() {
+    #if MAX_OUTPUT_COUNT > 0
+      for (size_t i = 0; i < output_count; i++) {
+        outputs[i]->updateOutput();
+      }
+    #endif
+  }
+
+  // Curve calibration commands (See LookupTableCalibrator), for every finger:
+  //   (LC)<point> capture the point from the current position, 0 is open
+  //   (LX)        clear the captured points
+  // The points are stored right away. Without a curve calibrator (or with
+  // ENABLE_CHANNEL_STORE), or for a point the curve doesn't have, nothing is
+  // changed and the command is answered with:
+  //   (LE)<the command>\n
+  bool handleCurvePoints(const char* input) {
+    bool capture = strncmp(input, "(LC)", 4) == 0;
+    if (!capture && strncmp(input, "(LX)", 4) != 0) return false;
+
+    int index = capture ? atoi(input + 4) : 0;
+    if (ENABLE_CHANNEL_STORE || index < 0 || index >= CALIBRATION_CURL::POINTS) {
+      char reply[24];
+      if (capture) {
+        snprintf(reply, sizeof(reply), "(LE)(LC)%d\n", index);
+      } else {
+        snprintf(reply, sizeof(reply), "(LE)(LX)\n");
+      }
+      comm->output(reply);
+      return true;
+    }
+
+    for (size_t i = 0; i < calibrated_count; i++) {
+      if (capture) {
+        calibrators[i]->capturePoint(index);
+      } else {
+        calibrators[i]->clearPoints();
+      }
+    }
+    Settings::store();
+    return true;
+  }
+
+  bool isOpen() const {
+    return comm_open;
+  }
+
+  const Handshake& getHandshake() const {
+    return handshake;
+  }
+
+ private:
+  // Returns the length of the encoded frame.
+  int encode() {
+    #if ENABLE_FIXED_WIDTH_ENCODING
+      if (handshake.uses(Handshake::FIXED_WIDTH)) {
+        return frame_template.encode(encoded_output_string);
+      }
+    #endif
+    return encodeAll(encoded_output_string, inputs, input_count);
+  }
+
+  void readCommands(bool wait) {
+    if (!wait && !comm->hasData()) return;
+
+    char received_bytes[100];
+    if (comm->readData(received_bytes, 100) &&
+        !handshake.handle(comm, received_bytes) &&
+        !handleGlobal(comm, received_bytes)
+        #if ENABLE_TELEMETRY
+          && !telemetry.handle(comm, received_bytes)
+        #endif
+        && !handleCurvePoints(received_bytes)
+        ) {
+      #if MAX_OUTPUT_COUNT > 0
+        for (size_t i = 0; i < output_count; i++) {
+          // Decode the update and write it to the output.
+          outputs[i]->decodeToOuput(received_bytes);
+        }
+      #endif
+    }
+  }
+
+  ICommunication* comm;
+  Button* calibration_button;
+
+  // These are composite lists of the hardware defined in HardwareConfig.hpp.
+  EncodedInput** inputs;
+  #if MAX_OUTPUT_COUNT > 0
+    DecodedOuput* outputs[MAX_OUTPUT_COUNT];
+  #endif
+  Calibrated* calibrators[MAX_CALIBRATED_COUNT];
+  size_t input_count;
+  size_t output_count;
+  size_t calibrated_count;
+
+  char* encoded_output_string;
+  Handshake handshake;
+  #if ENABLE_FIXED_WIDTH_ENCODING
+    FrameTemplate frame_template;
+  #endif
+  #if ENABLE_TELEMETRY
+    LinkTelemetry telemetry;
+  #endif
+  #if ENABLE_BATCHING
+    FrameBatcher batcher;
+  #endif
+
+  int calibration_count;
+  bool comm_open;
+};
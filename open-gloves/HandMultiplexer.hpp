@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Config.h"
+#include "ICommunication.hpp"
+
+#define HAND_MUX_LINE_LEN 100
+// How many lines can wait for each hand, the oldest is dropped when full.
+#define HAND_MUX_QUEUE    4
+
+// Carries both hands of a dual hand board over one communication channel.
+//
+// The lines are tagged the same way the espnow-bridge does with TAG_HANDS, so
+// the host side doesn't care whether the hands come from one board or two:
+//   firmware: (HL)A0123B0456...\n   every line from the first (left) hand
+//             (HR)A0123B0456...\n   every line from the second (right) hand
+//   driver:   (HL)<command>\n       only goes to the left hand
+//             (HR)<command>\n       only goes to the right hand
+//             <command>\n           goes to both hands
+// Lines read for one hand that belong to the other are queued until that hand
+// reads.
+//
+// Untagged commands that aren't about a hand (eg. settings) are first given to
+// the global handler, and only go to the hands if it didn't take them, so they
+// are applied once. Its answers are sent on the left hand's channel.
+class HandMultiplexer {
+ public:
+  static constexpr int TAG_SIZE = 4;
+
+  typedef bool (*CommandHandler)(ICommunication* comm, const char* input);
+
+  HandMultiplexer(ICommunication* comm, CommandHandler global_handler) :
+    comm(comm), global_handler(global_handler), started(false),
+    channels{Channel(this, 0), Channel(this, 1)}, queues{} {}
+
+  ICommunication* channel(int hand) {
+    return &channels[hand];
+  }
+
+ private:
+  class Channel : public ICommunication {
+   public:
+    Channel(HandMultiplexer* mux, int hand) : mux(mux), hand(hand), buffer(nullptr), capacity(0) {}
+
+    void start() {
+      if (!mux->started) mux->comm->start();
+      mux->started = true;
+    }
+
+    bool isOpen() {
+      return mux->comm->isOpen();
+    }
+
+    void output(char* data) {
+      // Every line gets the tag, batches hold several.
+      size_t lines = 1;
+      for (const char* c = data; *c != '\0'; c++) {
+        if (*c == '\n' && c[1] != '\0') lines++;
+      }
+      size_t needed = strlen(data) + lines * TAG_SIZE + 1;
+      if (needed > capacity) {
+        delete[] buffer;
+        buffer = new char[needed];
+        capacity = needed;
+      }
+
+      char* out = buffer;
+      bool line_start = true;
+      for (const char* c = data; *c != '\0'; c++) {
+        if (line_start) {
+          memcpy(out, tag(), TAG_SIZE);
+          out += TAG_SIZE;
+        }
+        *out++ = *c;
+        line_start = *c == '\n';
+      }
+      *out = '\0';
+      mux->comm->output(buffer);
+    }
+
+    bool hasData() {
+      return mux->queues[hand].count > 0 || mux->comm->hasData();
+    }
+
+    bool readData(char* input, size_t buffer_size) {
+      return mux->read(hand, input, buffer_size);
+    }
+
+   private:
+    const char* tag() const {
+      return hand == 0 ? "(HL)" : "(HR)";
+    }
+
+    HandMultiplexer* mux;
+    int hand;
+    char* buffer;
+    size_t capacity;
+  };
+
+  // Lines waiting for one hand.
+  struct Queue {
+    char lines[HAND_MUX_QUEUE][HAND_MUX_LINE_LEN];
+    uint8_t head;
+    uint8_t count;
+
+    void push(const char* line) {
+      if (count == HAND_MUX_QUEUE) {
+        head = (head + 1) % HAND_MUX_QUEUE;
+        count--;
+      }
+      char* slot = lines[(head + count) % HAND_MUX_QUEUE];
+      strncpy(slot, line, HAND_MUX_LINE_LEN - 1);
+      slot[HAND_MUX_LINE_LEN - 1] = '\0';
+      count++;
+    }
+
+    void pop(char* input, size_t buffer_size) {
+      strncpy(input, lines[head], buffer_size - 1);
+      input[buffer_size - 1] = '\0';
+      head = (head + 1) % HAND_MUX_QUEUE;
+      count--;
+    }
+  };
+
+  bool read(int hand, char* input, size_t buffer_size) {
+    if (queues[hand].count > 0) {
+      queues[hand].pop(input, buffer_size);
+      return true;
+    }
+
+    // Lines for the other hand are queued, look a few lines ahead for one
+    // for this hand. Only the first read may wait for the host, the lines
+    // after it are only read if they already arrived.
+    int other = 1 - hand;
+    for (int i = 0; i < HAND_MUX_QUEUE; i++) {
+      char line[HAND_MUX_LINE_LEN];
+      if (i > 0 && !comm->hasData()) break;
+      if (!comm->readData(line, sizeof(line))) break;
+
+      const char* command = line;
+      int target = -1;
+      if (strncmp(line, "(HL)", TAG_SIZE) == 0) target = 0;
+      if (strncmp(line, "(HR)", TAG_SIZE) == 0) target = 1;
+      if (target >= 0) command += TAG_SIZE;
+      if (command[0] == '\0') continue;
+
+      if (target < 0) {
+        if (global_handler(&channels[0], command)) continue;
+        queues[other].push(command);
+      } else if (target == other) {
+        queues[other].push(command);
+        continue;
+      }
+
+      strncpy(input, command, buffer_size - 1);
+      input[buffer_size - 1] = '\0';
+      return true;
+    }
+
+    input[0] = '\0';
+    return false;
+  }
+
+  ICommunication* comm;
+  CommandHandler global_handler;
+  bool started;
+  Channel channels[2];
+  Queue queues[2];
+};
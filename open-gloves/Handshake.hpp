@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Config.h"
+
+#include "DriverProtocol.hpp"
+#include "ICommunication.hpp"
+#include "Settings.hpp"
+
+// Negotiates the frame encoding and rate with the driver when the connection opens.
+//
+// Once the channel is open the firmware advertises what it has and supports. All
+// keys are bracketed so drivers that don't know the handshake ignore the line:
+//   (CV)<version>(CI)<input key mask>(CS)<splay>(CF)<force feedback count>
+//   (CH)<haptic count>(CM)<max value>(CE)<supported encodings>(CP)<min period ms>
+//   (CD)<default period ms>\n
+// The input key mask has bit (key - 'A') set for every input key the glove sends.
+// The encodings are a mask of Handshake::Encoding.
+//
+// The driver answers with the options it picked from the ones advertised:
+//   (CA)<encodings>(CP)<period ms>\n
+// and can ask for the advertisement again with (CQ). Until it answers, only the
+// encodings every driver understands are used, so older drivers keep working.
+class Handshake {
+ public:
+  enum Encoding : uint8_t {
+    ALPHA       = 1 << 0, // Plain text keys and values.
+    FIXED_WIDTH = 1 << 1, // Zero padded values patched into a frame template.
+    BATCHED     = 1 << 2, // Several timestamped samples per transmission.
+    TELEMETRY   = 1 << 3, // Sequence number and timestamp trailer, latency pings.
+  };
+
+  static constexpr int VERSION = 1;
+
+  static constexpr uint8_t SUPPORTED = ALPHA
+    | (ENABLE_FIXED_WIDTH_ENCODING ? FIXED_WIDTH : 0)
+    | (ENABLE_BATCHING ? BATCHED : 0)
+    | (ENABLE_TELEMETRY ? TELEMETRY : 0);
+
+  // Encodings used before a driver negotiates. Without the handshake everything
+  // enabled in the config is used, like before.
+  static constexpr uint8_t DEFAULTS = ENABLE_HANDSHAKE ? (SUPPORTED & (ALPHA | FIXED_WIDTH)) : SUPPORTED;
+
+  Handshake() : encodings(DEFAULTS), period(0), was_open(false), changed(false),
+                input_mask(0) {}
+
+  bool uses(Encoding encoding) const {
+    return encodings & encoding;
+  }
+
+  // The negotiated period, or the comm_delay setting if the driver didn't pick one.
+  int getPeriod() const {
+    return period > 0 ? period : settings.comm_delay;
+  }
+
+  // True once after the options changed, so the caller can rebuild anything
+  // that depends on them.
+  bool optionsChanged() {
+    bool result = changed;
+    changed = false;
+    return result;
+  }
+
+  // Advertise when the connection opens and go back to the defaults when it
+  // closes, the next driver may not know the handshake. Call once per loop.
+  void update(ICommunication* comm, bool open, EncodedInput* inputs[], size_t count) {
+    #if ENABLE_HANDSHAKE
+      if (open && !was_open) {
+        advertise(comm, inputs, count);
+      } else if (!open && was_open) {
+        select(DEFAULTS, 0);
+      }
+      was_open = open;
+    #endif
+  }
+
+  // Handle handshake messages from the driver. Returns true if the message was
+  // consumed and should not be passed on to the outputs.
+  bool handle(ICommunication* comm, const char* input) {
+    #if ENABLE_HANDSHAKE
+      if (strncmp(input, "(CQ)", 4) == 0) {
+        advertise(comm);
+        return true;
+      }
+
+      if (strncmp(input, "(CA)", 4) == 0) {
+        uint8_t requested = atoi(input + 4);
+        const char* period_key = strstr(input, "(CP)");
+        int requested_period = period_key != NULL ? atoi(period_key + 4) : getPeriod();
+
+        // Only accept what was advertised, alpha is always available as a fallback.
+        select((requested & SUPPORTED) | ALPHA, max(requested_period, HANDSHAKE_MIN_PERIOD));
+        return true;
+      }
+    #endif
+    return false;
+  }
+
+ private:
+  void advertise(ICommunication* comm, EncodedInput* inputs[], size_t count) {
+    input_mask = 0;
+    for (size_t i = 0; i < count; i++) {
+      input_mask |= 1UL << (inputs[i]->getType() - 'A');
+    }
+    advertise(comm);
+  }
+
+  void advertise(ICommunication* comm) {
+    char message[128];
+    snprintf(message, sizeof(message),
+             "(CV)%d(CI)%lu(CS)%d(CF)%d(CH)%d(CM)%d(CE)%d(CP)%d(CD)%d\n",
+             VERSION, input_mask, ENABLE_SPLAY ? 1 : 0, FORCE_FEEDBACK_COUNT, HAPTIC_COUNT,
+             ANALOG_MAX, SUPPORTED, HANDSHAKE_MIN_PERIOD, (int)settings.comm_delay);
+    comm->output(message);
+  }
+
+  void select(uint8_t new_encodings, int new_period) {
+    changed |= new_encodings != encodings || new_period != period;
+    encodings = new_encodings;
+    period = new_period;
+  }
+
+  uint8_t encodings;
+  int period;
+  bool was_open;
+  bool changed;
+  unsigned long input_mask;
+};
@@ -16,7 +16,7 @@ class HapticMotor : public DecodedOuput {
   }
 
   void decodeToOuput(const char* input) override {
-    char* start = strchr(input, frequency_key);
+    const char* start = strchr(input, frequency_key);
     if (start != NULL) {
       frequency = atoi(start + 1);
     }
@@ -35,7 +35,7 @@ class HapticMotor : public DecodedOuput {
   }
 
   void updateOutput() override {
-    if (duration > 0 && millis() < haptic_start + duration) {
+    if (duration > 0 && millis() - haptic_start < (unsigned long)duration) {
       // If there is duration remaining, keep the motor on.
       digitalWrite(motor_pin, HIGH);
     } else {
@@ -53,5 +53,5 @@ class HapticMotor : public DecodedOuput {
   int frequency;
   int duration;
   int amplitude;
-  int haptic_start;
+  unsigned long haptic_start;
 };
@@ -8,6 +8,7 @@
 #include "ForceFeedback.hpp"
 #include "Gesture.hpp"
 #include "Haptics.hpp"
+#include "IMU.hpp"
 #include "JoyStick.hpp"
 #include "LED.hpp"
 
@@ -62,25 +63,56 @@ Finger* fingers[FINGER_COUNT] = {
   &finger_index, &finger_middle, &finger_ring, &finger_pinky
 };
 
+#if ENABLE_JOYSTICK
+  JoyStick joystick(PIN_JOY_X, PIN_JOY_Y);
+#endif
+
+JoyStick* sticks[STICK_COUNT] = {
+  #if ENABLE_JOYSTICK
+    &joystick
+  #endif
+};
+
 JoyStickAxis* joysticks[JOYSTICK_COUNT] = {
   #if ENABLE_JOYSTICK
-    new JoyStickAxis(EncodedInput::Type::JOY_X, PIN_JOY_X, JOYSTICK_DEADZONE, INVERT_JOY_X),
-    new JoyStickAxis(EncodedInput::Type::JOY_Y, PIN_JOY_Y, JOYSTICK_DEADZONE, INVERT_JOY_Y)
+    new JoyStickAxis(EncodedInput::Type::JOY_X, &joystick, JoyStick::X),
+    new JoyStickAxis(EncodedInput::Type::JOY_Y, &joystick, JoyStick::Y)
+  #endif
+};
+
+IMUInput* imus[IMU_COUNT] = {
+  #if ENABLE_IMU
+    new IMUInput(EncodedInput::Type::ORIENTATION, IMU_I2C_ADDRESS)
   #endif
 };
 
+// The fingers in the order gesture rules list their weights.
+Finger* hand[5] = {
+  #if ENABLE_THUMB
+    &finger_thumb,
+  #else
+    NULL,
+  #endif
+  &finger_index, &finger_middle, &finger_ring, &finger_pinky
+};
+
 Gesture* gestures[GESTURE_COUNT] = {
   #if TRIGGER_GESTURE
-    new TriggerGesture(&finger_index),
+    new RuleGesture(GestureRule TRIGGER_GESTURE_RULE, hand),
   #endif
   #if GRAB_GESTURE
-    new GrabGesture(&finger_index, &finger_middle, &finger_ring, &finger_pinky),
+    new RuleGesture(GestureRule GRAB_GESTURE_RULE, hand),
   #endif
   #if PINCH_GESTURE
-    new PinchGesture(&finger_thumb, &finger_index)
+    new RuleGesture(GestureRule PINCH_GESTURE_RULE, hand),
   #endif
 };
 
+// The empty rule at the end lets the list of custom rules be empty.
+const GestureRule custom_gesture_rules[] = { CUSTOM_GESTURE_RULES {} };
+#define CUSTOM_GESTURE_COUNT (sizeof(custom_gesture_rules) / sizeof(GestureRule) - 1)
+Gesture** custom_gestures = createRuleGestures(custom_gesture_rules, CUSTOM_GESTURE_COUNT, hand);
+
 HapticMotor* haptics[HAPTIC_COUNT] = {
   #if ENABLE_HAPTICS
     new HapticMotor(DecodedOuput::Type::HAPTIC_FREQ,
@@ -118,3 +150,7 @@ ForceFeedback* force_feedbacks[FORCE_FEEDBACK_COUNT] {
     #endif
   #endif
 };
+
+#if ENABLE_DUAL_HAND
+  #include "SecondHandConfig.hpp"
+#endif
@@ -0,0 +1,402 @@
+#pragma once
+
+#include "Config.h"
+
+#include "DriverProtocol.hpp"
+
+#if ENABLE_IMU
+  #include <Wire.h>
+#endif
+
+// The I2C pins can't be shared with anything else that is enabled.
+#if defined(ESP32)
+  #define IMU_USES_PIN(pin) (ENABLE_IMU && ((pin) == PIN_IMU_SDA || (pin) == PIN_IMU_SCL))
+#endif
+#if ENABLE_IMU && defined(ESP32)
+  #if IMU_USES_PIN(PIN_A_BTN) || IMU_USES_PIN(PIN_B_BTN) || \
+      IMU_USES_PIN(PIN_MENU_BTN) || IMU_USES_PIN(PIN_CALIB) || \
+      (ENABLE_JOYSTICK && IMU_USES_PIN(PIN_JOY_BTN)) || \
+      (!TRIGGER_GESTURE && IMU_USES_PIN(PIN_TRIG_BTN)) || \
+      (!GRAB_GESTURE && IMU_USES_PIN(PIN_GRAB_BTN)) || \
+      (!PINCH_GESTURE && IMU_USES_PIN(PIN_PNCH_BTN))
+    #error "A button is on one of the IMU's I2C pins (PIN_IMU_...), move it to a free pin."
+  #endif
+  #if ENABLE_FORCE_FEEDBACK && \
+      (IMU_USES_PIN(PIN_PINKY_FFB) || IMU_USES_PIN(PIN_RING_FFB) || IMU_USES_PIN(PIN_MIDDLE_FFB) || \
+       IMU_USES_PIN(PIN_INDEX_FFB) || (ENABLE_THUMB && IMU_USES_PIN(PIN_THUMB_FFB)))
+    #error "Force feedback is on one of the IMU's I2C pins (PIN_IMU_...), move them to free pins."
+  #endif
+  #if ENABLE_HAPTICS && IMU_USES_PIN(PIN_HAPTIC)
+    #error "The haptic motor is on one of the IMU's I2C pins (PIN_IMU_...), move it to a free pin."
+  #endif
+  #if EXTERNAL_ADC != EXTERNAL_ADC_NONE && \
+      (IMU_USES_PIN(PIN_ADC_CS) || IMU_USES_PIN(PIN_ADC_SCK) || IMU_USES_PIN(PIN_ADC_MISO) || IMU_USES_PIN(PIN_ADC_MOSI))
+    #error "The external ADC is on one of the IMU's I2C pins (PIN_IMU_...), move it to free pins."
+  #endif
+#endif
+
+// Mahony orientation filter in fixed point.
+//
+// The quaternion is kept in Q30 and every sample is fused with 32x32->64 bit
+// multiplies only, so it is cheap enough to run at the IMU's native rate.
+// The accelerometer pulls the estimate towards gravity with the proportional
+// gain IMU_MAHONY_KP and the optional integral gain IMU_MAHONY_KI, which
+// corrects gyro bias. Without a magnetometer yaw is relative to the start.
+class MahonyFilter {
+ public:
+  static constexpr int32_t ONE = 1L << 30;
+
+  // Half the rotation per gyro LSB per sample in Q46.
+  static constexpr int32_t GYRO_HALF_STEP =
+    0.5 * (3.14159265358979 / 180.0) / IMU_GYRO_LSB_PER_DPS / IMU_SAMPLE_RATE * (1LL << 46) + 0.5;
+  // Gains scaled to half angle steps per sample, Q24 and Q40.
+  static constexpr int32_t KP_STEP = IMU_MAHONY_KP * 0.5 / IMU_SAMPLE_RATE * (1L << 24) + 0.5;
+  static constexpr int32_t KI_STEP =
+    IMU_MAHONY_KI * 0.5 / IMU_SAMPLE_RATE / IMU_SAMPLE_RATE * (1LL << 40) + 0.5;
+
+  MahonyFilter() : q{ONE, 0, 0, 0}, integral{0, 0, 0} {}
+
+  // Fuse one sample of raw gyro and accelerometer readings.
+  void update(const int16_t gyro[3], const int16_t accel[3]) {
+    int32_t h[3];
+    for (int i = 0; i < 3; i++) {
+      h[i] = ((int64_t)gyro[i] * GYRO_HALF_STEP) >> 16;
+    }
+
+    // Skip the correction in free fall, there is no gravity to align with.
+    uint32_t accel_squared = 0;
+    for (int i = 0; i < 3; i++) {
+      accel_squared += (int32_t)accel[i] * accel[i];
+    }
+    uint32_t accel_norm = isqrt(accel_squared);
+    if (accel_norm > 0) {
+      int32_t a[3];
+      for (int i = 0; i < 3; i++) {
+        a[i] = ((int64_t)accel[i] << 30) / accel_norm;
+      }
+
+      // Direction of gravity according to the current estimate.
+      int32_t v[3] = {
+        2 * (mul(q[1], q[3]) - mul(q[0], q[2])),
+        2 * (mul(q[0], q[1]) + mul(q[2], q[3])),
+        mul(q[0], q[0]) - mul(q[1], q[1]) - mul(q[2], q[2]) + mul(q[3], q[3])
+      };
+
+      // The error is the rotation between the measured and estimated gravity.
+      int32_t e[3] = {
+        mul(a[1], v[2]) - mul(a[2], v[1]),
+        mul(a[2], v[0]) - mul(a[0], v[2]),
+        mul(a[0], v[1]) - mul(a[1], v[0])
+      };
+
+      for (int i = 0; i < 3; i++) {
+        if (KI_STEP > 0) {
+          integral[i] += ((int64_t)e[i] * KI_STEP) >> 40;
+          h[i] += integral[i];
+        }
+        h[i] += ((int64_t)e[i] * KP_STEP) >> 24;
+      }
+    }
+
+    // q += q * (0, h)
+    int32_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    q[0] += -mul(q1, h[0]) - mul(q2, h[1]) - mul(q3, h[2]);
+    q[1] +=  mul(q0, h[0]) + mul(q2, h[2]) - mul(q3, h[1]);
+    q[2] +=  mul(q0, h[1]) - mul(q1, h[2]) + mul(q3, h[0]);
+    q[3] +=  mul(q0, h[2]) + mul(q1, h[1]) - mul(q2, h[0]);
+
+    // The norm only drifts a little each step, one Newton step of the
+    // inverse square root around 1 keeps it normalized without a division.
+    int64_t norm = ((int64_t)q[0] * q[0] + (int64_t)q[1] * q[1] +
+                    (int64_t)q[2] * q[2] + (int64_t)q[3] * q[3]) >> 30;
+    int32_t factor = (3LL * ONE - norm) / 2;
+    for (int i = 0; i < 4; i++) {
+      q[i] = mul(q[i], factor);
+    }
+  }
+
+  // w, x, y, z in Q30.
+  const int32_t* getQuaternion() const {
+    return q;
+  }
+
+ private:
+  static inline int32_t mul(int32_t a, int32_t b) {
+    return ((int64_t)a * b) >> 30;
+  }
+
+  static uint32_t isqrt(uint32_t value) {
+    uint32_t result = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value) bit >>= 2;
+    while (bit != 0) {
+      if (value >= result + bit) {
+        value -= result + bit;
+        result = (result >> 1) + bit;
+      } else {
+        result >>= 1;
+      }
+      bit >>= 2;
+    }
+    return result;
+  }
+
+  int32_t q[4];
+  int32_t integral[3];
+};
+
+// Hand orientation from an MPU6050 or MPU6500 on I2C.
+//
+// The sensor samples at IMU_SAMPLE_RATE into its FIFO. The FIFO is read in
+// bursts and each sample is fused, so the orientation is updated at the
+// sensor's rate no matter how fast the frames are sent. The I2C reads block:
+//  * On the ESP32 a task pinned to the other core empties the FIFOs of every
+//    IMU each IMU_TASK_PERIOD and publishes the quaternions, the loop only
+//    copies the latest one.
+//  * Elsewhere every loop reads up to IMU_MAX_SAMPLES, which bounds the time
+//    the IMU takes from a loop, and samples left over are read in the next loops.
+//
+// The quaternion is encoded with the "smallest three" scheme: the largest
+// component is dropped (it follows from the others since the quaternion is
+// normalized) and the sign is flipped to make it positive. The index of the
+// dropped component is sent followed by the other three, each mapped from
+// -1/sqrt(2) to 1/sqrt(2) onto 4 zero padded digits:
+//   (W)<index><value><value><value>  eg. (W)0500049991234
+class IMUInput : public EncodedInput {
+ public:
+  IMUInput(EncodedInput::Type type, uint8_t address) :
+    type(type), address(address), dropped_index(0), values{5000, 5000, 5000}
+    #if ENABLE_IMU && defined(ESP32)
+      , published{MahonyFilter::ONE, 0, 0, 0}
+    #endif
+    {}
+
+  void setupInput() override {
+    #if ENABLE_IMU
+      #if defined(ESP32)
+        Wire.begin(PIN_IMU_SDA, PIN_IMU_SCL);
+      #else
+        Wire.begin();
+      #endif
+      Wire.setClock(400000);
+
+      writeRegister(PWR_MGMT_1, 0x80); // Reset.
+      delay(100);
+      writeRegister(PWR_MGMT_1, 0x01); // Clock from the gyro PLL.
+      writeRegister(CONFIG, DLPF_CFG); // 1kHz internal rate.
+      writeRegister(SMPLRT_DIV, 1000 / IMU_SAMPLE_RATE - 1);
+      writeRegister(GYRO_CONFIG, GYRO_FS_SEL << 3);
+      writeRegister(ACCEL_CONFIG, 0x08); // +-4g
+      writeRegister(INT_ENABLE, FIFO_OFLOW_INT); // Flag overflows in INT_STATUS.
+      resetFifo();
+      writeRegister(FIFO_EN, 0x78);    // Gyro and accelerometer.
+
+      #if defined(ESP32)
+        portENTER_CRITICAL(&lock);
+        task_imus[task_imu_count++] = this;
+        portEXIT_CRITICAL(&lock);
+        if (task_imu_count == 1) {
+          xTaskCreatePinnedToCore(task, "imu", 4096, nullptr, 1, nullptr, IMU_TASK_CORE);
+        }
+      #endif
+    #endif
+  }
+
+  void readInput() override {
+    #if ENABLE_IMU
+      #if defined(ESP32)
+        int32_t q[4];
+        portENTER_CRITICAL(&lock);
+        memcpy(q, published, sizeof(q));
+        portEXIT_CRITICAL(&lock);
+        compress(q);
+      #else
+        readFifo(IMU_MAX_SAMPLES);
+        compress(filter.getQuaternion());
+      #endif
+    #endif
+  }
+
+  EncodedInput::Type getType() const override {
+    return type;
+  }
+
+  inline int getEncodedSize() const override {
+    // Encode string size = (W) + index + 3 * XXXX
+    return 3 + 1 + 3 * 4;
+  }
+
+  int encode(char* output) const override {
+    return encodeTemplate(output);
+  }
+
+  int encodeTemplate(char* output) const override {
+    output[0] = '(';
+    output[1] = type;
+    output[2] = ')';
+    patchTemplate(output);
+    return getEncodedSize();
+  }
+
+  void patchTemplate(char* output) const override {
+    output[3] = '0' + dropped_index;
+    for (int i = 0; i < 3; i++) {
+      encodeDigits(output + 4 + i * 4, values[i], 4);
+    }
+  }
+
+ private:
+  static constexpr int32_t MAX_COMPONENT = MahonyFilter::ONE * 0.70710678118654752 + 0.5;
+  static constexpr uint8_t SAMPLE_SIZE = 12;
+  // More samples than fit in the FIFO.
+  static constexpr int FIFO_SAMPLES = 1024 / SAMPLE_SIZE;
+  // Samples per I2C read, limited by the size of the Wire buffer.
+  #if defined(ESP32)
+    static constexpr int BURST_SAMPLES = 10;
+  #else
+    static constexpr int BURST_SAMPLES = 2;
+  #endif
+  // The low pass below half the sample rate: 184, 94 or 44Hz.
+  static constexpr uint8_t DLPF_CFG = IMU_SAMPLE_RATE >= 400 ? 1 : IMU_SAMPLE_RATE >= 200 ? 2 : 3;
+  static constexpr uint8_t GYRO_FS_SEL =
+    IMU_GYRO_RANGE >= 2000 ? 3 : IMU_GYRO_RANGE >= 1000 ? 2 : IMU_GYRO_RANGE >= 500 ? 1 : 0;
+
+  // Bit in INT_ENABLE and INT_STATUS.
+  static constexpr uint8_t FIFO_OFLOW_INT = 0x10;
+
+  enum Register : uint8_t {
+    SMPLRT_DIV = 0x19,
+    CONFIG = 0x1A,
+    GYRO_CONFIG = 0x1B,
+    ACCEL_CONFIG = 0x1C,
+    FIFO_EN = 0x23,
+    INT_ENABLE = 0x38,
+    INT_STATUS = 0x3A,
+    USER_CTRL = 0x6A,
+    PWR_MGMT_1 = 0x6B,
+    FIFO_COUNT_H = 0x72,
+    FIFO_R_W = 0x74
+  };
+
+  void compress(const int32_t* q) {
+    int largest = 0;
+    for (int i = 1; i < 4; i++) {
+      if (abs(q[i]) > abs(q[largest])) largest = i;
+    }
+
+    dropped_index = largest;
+    int sign = q[largest] < 0 ? -1 : 1;
+    for (int i = 0, j = 0; i < 4; i++) {
+      if (i == largest) continue;
+      int64_t component = constrain((int64_t)q[i] * sign, -MAX_COMPONENT, MAX_COMPONENT);
+      values[j++] = ((component + MAX_COMPONENT) * 9999 + MAX_COMPONENT) / (2 * MAX_COMPONENT);
+    }
+  }
+
+  #if ENABLE_IMU
+    // Fuse up to max_samples from the FIFO.
+    void readFifo(int max_samples) {
+    // The FIFO (1024 bytes on the MPU6050, 512 on the MPU6500) drops its
+    // oldest bytes when it overflows, and is no longer aligned on samples.
+    if (readRegister(INT_STATUS) & FIFO_OFLOW_INT) {
+      resetFifo();
+      return;
+    }
+
+    uint16_t count = readFifoCount();
+
+    int samples = min((int)(count / SAMPLE_SIZE), max_samples);
+    while (samples > 0) {
+      int burst = min(samples, BURST_SAMPLES);
+      Wire.beginTransmission(address);
+      Wire.write(FIFO_R_W);
+      Wire.endTransmission(false);
+      Wire.requestFrom(address, (uint8_t)(burst * SAMPLE_SIZE));
+
+      for (int i = 0; i < burst; i++) {
+        uint8_t data[SAMPLE_SIZE];
+        for (int j = 0; j < SAMPLE_SIZE; j++) data[j] = Wire.read();
+
+        int16_t accel[3], gyro[3];
+        for (int axis = 0; axis < 3; axis++) {
+          accel[axis] = (data[axis * 2] << 8) | data[axis * 2 + 1];
+          gyro[axis] = (data[6 + axis * 2] << 8) | data[6 + axis * 2 + 1];
+        }
+        filter.update(gyro, accel);
+      }
+      samples -= burst;
+    }
+    }
+
+    #if defined(ESP32)
+      static void task(void*) {
+        TickType_t wake = xTaskGetTickCount();
+        while (true) {
+          portENTER_CRITICAL(&lock);
+          int count = task_imu_count;
+          portEXIT_CRITICAL(&lock);
+
+          for (int i = 0; i < count; i++) {
+            IMUInput* imu = task_imus[i];
+            imu->readFifo(FIFO_SAMPLES);
+            portENTER_CRITICAL(&lock);
+            memcpy(imu->published, imu->filter.getQuaternion(), sizeof(imu->published));
+            portEXIT_CRITICAL(&lock);
+          }
+          vTaskDelayUntil(&wake, pdMS_TO_TICKS(IMU_TASK_PERIOD));
+        }
+      }
+    #endif
+
+    void resetFifo() {
+      writeRegister(USER_CTRL, 0x04);
+      writeRegister(USER_CTRL, 0x40);
+    }
+
+    void writeRegister(uint8_t reg, uint8_t value) {
+      Wire.beginTransmission(address);
+      Wire.write(reg);
+      Wire.write(value);
+      Wire.endTransmission();
+    }
+
+    // Reading INT_STATUS clears it.
+    uint8_t readRegister(uint8_t reg) {
+      Wire.beginTransmission(address);
+      Wire.write(reg);
+      Wire.endTransmission(false);
+      Wire.requestFrom(address, (uint8_t)1);
+      return Wire.read();
+    }
+
+    // Both halves of the count in one read.
+    uint16_t readFifoCount() {
+      Wire.beginTransmission(address);
+      Wire.write(FIFO_COUNT_H);
+      Wire.endTransmission(false);
+      Wire.requestFrom(address, (uint8_t)2);
+      uint16_t count = Wire.read() << 8;
+      return count | Wire.read();
+    }
+  #endif
+
+  const EncodedInput::Type type;
+  const uint8_t address;
+  MahonyFilter filter;
+  uint8_t dropped_index;
+  int values[3];
+  #if ENABLE_IMU && defined(ESP32)
+    // Written by the task, the latest quaternion.
+    int32_t published[4];
+
+    static portMUX_TYPE lock;
+    static IMUInput* task_imus[HAND_COUNT];
+    static int task_imu_count;
+  #endif
+};
+
+#if ENABLE_IMU && defined(ESP32)
+  portMUX_TYPE IMUInput::lock = portMUX_INITIALIZER_UNLOCKED;
+  IMUInput* IMUInput::task_imus[HAND_COUNT];
+  int IMUInput::task_imu_count = 0;
+#endif
@@ -2,54 +2,288 @@
 
 #include "Config.h"
 
+#include "Calibration.hpp"
 #include "DriverProtocol.hpp"
+#include "LoopBudget.hpp"
+#include "SampleTrace.hpp"
+#include "Settings.hpp"
 
-class JoyStickAxis : public EncodedInput {
+// Both axes of a joystick, processed together.
+//
+// The rest position is learned from the first sample and then follows the
+// stick slowly while it is inside the deadzone, so sticks that don't rest at
+// exactly ANALOG_MAX/2 or drift over time stay centered. While calibrating the
+// extents of each direction are learned as well, and each direction is scaled
+// so the full throw reaches the edge of the output range. Pressing the
+// calibration button starts both over from the current position.
+//
+// The deadzone is radial: the stick is centered while its distance from the
+// center is inside the deadzone, and outside of it the distance is rescaled so
+// the output starts at the center instead of jumping to the deadzone's edge.
+// Everything is integer math, the reciprocals are only recalculated when the
+// calibration or the settings change. With 10 bit inputs (AVR) the products fit
+// in 32 bits, so the 64 bit multiplies that larger ranges need are skipped.
+//
+// The learned center and extents are kept in the settings (joy_center_x ...),
+// so they are saved with (PW) and stored automatically when a timed
+// calibration learned something new. A center of -1 is learned again from the
+// next sample. The second hand's joystick uses the joy2_ settings instead.
+// The offsets and the scales stay small enough for 32 bit products.
+#define JOYSTICK_32BIT (ANALOG_MAX <= 1023)
+
+class JoyStick : public Calibrated {
  public:
-  JoyStickAxis(EncodedInput::Type type, int pin, float dead_zone, bool invert) :
-    type(type), pin(pin), dead_zone(dead_zone), invert(invert), value(ANALOG_MAX/2) {}
+  enum Axis : uint8_t {
+    X,
+    Y
+  };
 
-  void readInput() override {
-    // Read the latest value.
-    int new_value = analogRead(pin);
+  JoyStick(int pin_x, int pin_y, bool second_hand = false) :
+    center_settings{second_hand ? &settings.joy2_center_x : &settings.joy_center_x,
+                    second_hand ? &settings.joy2_center_y : &settings.joy_center_y},
+    min_settings{second_hand ? &settings.joy2_min_x : &settings.joy_min_x,
+                 second_hand ? &settings.joy2_min_y : &settings.joy_min_y},
+    max_settings{second_hand ? &settings.joy2_max_x : &settings.joy_max_x,
+                 second_hand ? &settings.joy2_max_y : &settings.joy_max_y},
+    pins{pin_x, pin_y}, smoothed{0, 0},
+    centers{0, 0}, scales{{0, 0}, {0, 0}}, dead_zone(-1), dead_zone_scale(0),
+    values{HALF, HALF}, learn_center(true), reset_extents(false), stored(true), primed(false) {
+    calibrate = false;
+  }
+
+  void readInput() {
+    // The joystick can be sampled less often when the loop is over budget.
+    if (!LoopBudget::sampleSecondary()) return;
+
+    if (settings.joystick_deadzone_raw != dead_zone) updateDeadZone();
+
+    int raw[2];
+    for (int axis = 0; axis < 2; axis++) {
+      raw[axis] = SampleTrace::analog(pins[axis]);
+      #if JOYSTICK_SMOOTHING > 0
+        // Exponential smoothing in Q4 so small steps still add up.
+        if (!primed) smoothed[axis] = raw[axis] << 4;
+        smoothed[axis] += ((raw[axis] << 4) - smoothed[axis]) >> JOYSTICK_SMOOTHING;
+        raw[axis] = smoothed[axis] >> 4;
+      #endif
+    }
+    primed = true;
+
+    if (learn_center || *center_settings[X] < 0 || *center_settings[Y] < 0) {
+      learnCenter(raw);
+    }
+
+    if (calibrate) updateExtents(raw);
+
+    // Offset from the center, scaled so the full throw in each direction is
+    // HALF. Past the learned extents it is clamped so the distance below still
+    // fits in 32 bits.
+    int32_t offsets[2];
+    for (int axis = 0; axis < 2; axis++) {
+      int32_t offset = raw[axis] - (centers[axis] >> 8);
+      #if JOYSTICK_32BIT
+        // Under 2^29.
+        offsets[axis] = (offset * scales[axis][offset > 0]) >> 16;
+      #else
+        offsets[axis] = ((int64_t)offset * scales[axis][offset > 0]) >> 16;
+      #endif
+      offsets[axis] = constrain(offsets[axis], (int32_t)-ANALOG_MAX, (int32_t)ANALOG_MAX);
+    }
+
+    uint32_t distance_squared = (uint32_t)(offsets[X] * offsets[X]) + (uint32_t)(offsets[Y] * offsets[Y]);
+    if (distance_squared <= (uint32_t)dead_zone * dead_zone) {
+      // Slowly follow the rest position, but not a stick held slightly off center.
+      if (distance_squared <= (uint32_t)dead_zone * dead_zone / 4) {
+        for (int axis = 0; axis < 2; axis++) {
+          centers[axis] += (((int32_t)raw[axis] << 8) - centers[axis]) >> 8;
+        }
+      }
+      values[X] = values[Y] = HALF;
+    } else {
+      // Rescale the distance outside of the deadzone to start from the center.
+      int distance = isqrt(distance_squared);
+      #if JOYSTICK_32BIT
+        // Under 2^30.
+        int32_t target = ((int32_t)(distance - dead_zone) * dead_zone_scale) >> 16;
+      #else
+        int32_t target = ((int64_t)(distance - dead_zone) * dead_zone_scale) >> 16;
+      #endif
+      int32_t ratio = (target << 8) / distance;
+      for (int axis = 0; axis < 2; axis++) {
+        int value = HALF + (((int32_t)offsets[axis] * ratio) >> 8);
+        values[axis] = constrain(value, 0, ANALOG_MAX);
+      }
+    }
 
-    // Apply the deadzone to the value.
-    new_value = filterDeadZone(new_value);
+    if (settings.invert_joy_x) values[X] = ANALOG_MAX - values[X];
+    if (settings.invert_joy_y) values[Y] = ANALOG_MAX - values[Y];
+  }
+
+  int getValue(Axis axis) const {
+    return values[axis];
+  }
 
-    // Invert if required.
-    if (invert) {
-      new_value = ANALOG_MAX - new_value;
+  // Use the center and extents in the settings, eg. after they were changed.
+  void loadCalibration() override {
+    for (int axis = 0; axis < 2; axis++) {
+      if (*center_settings[axis] >= 0) centers[axis] = *center_settings[axis] << 8;
     }
+    learn_center = *center_settings[X] < 0 || *center_settings[Y] < 0;
+    updateScales();
+  }
 
-    // Update the value.
-    value = new_value;
+  void resetCalibration() override {
+    learn_center = true;
+    reset_extents = true;
+  }
+
+  void disableCalibration() override {
+    // Store what was learned once a calibration finishes.
+    if (calibrate && !stored) {
+      saveCalibration();
+      Settings::store();
+      stored = true;
+    }
+    Calibrated::disableCalibration();
+  }
+
+ private:
+  static constexpr int HALF = ANALOG_MAX / 2;
+  // Directions that moved less than this are scaled as if they could reach it.
+  static constexpr int MIN_THROW = ANALOG_MAX / 8;
+
+  void learnCenter(const int raw[2]) {
+    for (int axis = 0; axis < 2; axis++) {
+      centers[axis] = (int32_t)raw[axis] << 8;
+      // Collapse the extents onto the new center so they are learned again.
+      if (reset_extents) {
+        *min_settings[axis] = raw[axis];
+        *max_settings[axis] = raw[axis];
+      }
+    }
+    learn_center = false;
+    reset_extents = false;
+    saveCalibration();
+    stored = false;
+    updateScales();
+  }
+
+  void updateExtents(const int raw[2]) {
+    bool changed = false;
+    for (int axis = 0; axis < 2; axis++) {
+      if (raw[axis] < *min_settings[axis]) {
+        *min_settings[axis] = raw[axis];
+        changed = true;
+      }
+      if (raw[axis] > *max_settings[axis]) {
+        *max_settings[axis] = raw[axis];
+        changed = true;
+      }
+    }
+    if (changed) {
+      stored = false;
+      updateScales();
+    }
+  }
+
+  // Q16 scales from raw offsets to the output range, for each direction.
+  void updateScales() {
+    for (int axis = 0; axis < 2; axis++) {
+      int center = centers[axis] >> 8;
+      int below = max(center - (int)*min_settings[axis], MIN_THROW);
+      int above = max((int)*max_settings[axis] - center, MIN_THROW);
+      scales[axis][0] = ((int32_t)HALF << 16) / below;
+      scales[axis][1] = ((int32_t)HALF << 16) / above;
+    }
+  }
+
+  void updateDeadZone() {
+    // A deadzone past 7/8 of the throw would leave no range to rescale into.
+    dead_zone = min(settings.joystick_deadzone_raw, HALF * 7 / 8);
+    dead_zone_scale = ((int32_t)HALF << 16) / (HALF - dead_zone);
+  }
+
+  void saveCalibration() {
+    for (int axis = 0; axis < 2; axis++) {
+      *center_settings[axis] = centers[axis] >> 8;
+    }
+  }
+
+  static int isqrt(uint32_t value) {
+    uint32_t result = 0;
+    // The highest power of 4 the distance squared can reach.
+    uint32_t bit = JOYSTICK_32BIT ? 1UL << 20 : 1UL << 30;
+    while (bit > value) bit >>= 2;
+    while (bit != 0) {
+      if (value >= result + bit) {
+        value -= result + bit;
+        result = (result >> 1) + bit;
+      } else {
+        result >>= 1;
+      }
+      bit >>= 2;
+    }
+    return result;
+  }
+
+  int32_t* const center_settings[2];
+  int32_t* const min_settings[2];
+  int32_t* const max_settings[2];
+
+  const int pins[2];
+  int32_t smoothed[2];
+  int32_t centers[2];   // Q8
+  int32_t scales[2][2]; // Q16, below and above the center.
+  int dead_zone;
+  int32_t dead_zone_scale; // Q16
+  int values[2];
+  bool learn_center;
+  bool reset_extents;
+  bool stored;
+  bool primed;
+};
+
+// One axis of a JoyStick, encoded with its own key so the driver still gets
+// JOY_X and JOY_Y. The X axis samples the stick for both of them.
+class JoyStickAxis : public EncodedInput {
+ public:
+  JoyStickAxis(EncodedInput::Type type, JoyStick* stick, JoyStick::Axis axis) :
+    type(type), stick(stick), axis(axis) {}
+
+  void readInput() override {
+    if (axis == JoyStick::X) stick->readInput();
+  }
+
+  EncodedInput::Type getType() const override {
+    return type;
   }
 
   inline int getEncodedSize() const override {
     // Encode string size = AXXXX + '\0'
-    return 6;
+    return 1 + ENCODED_VALUE_DIGITS + 1;
   }
 
   int encode(char* output) const override {
-    return snprintf(output, getEncodedSize(), "%c%d", type, value);
+    return snprintf(output, getEncodedSize(), "%c%d", type, getValue());
   }
 
-  int getValue() const {
-    return value;
+  int encodeTemplate(char* output) const override {
+    // Template = A + digits
+    output[0] = type;
+    patchTemplate(output);
+    return 1 + ENCODED_VALUE_DIGITS;
   }
 
- private:
-  int filterDeadZone(int in) {
-    // This function clamps the input to the center of the range if
-    // the value is within the threshold. This is to eliminate at-rest
-    // noise of the joystick.
-    int center = ANALOG_MAX/2;
-    return abs(center - in) < dead_zone * ANALOG_MAX ? center : in;
+  void patchTemplate(char* output) const override {
+    encodeDigits(output + 1, getValue(), ENCODED_VALUE_DIGITS);
   }
 
+  int getValue() const {
+    return stick->getValue(axis);
+  }
+
+ private:
   EncodedInput::Type type;
-  int pin;
-  float dead_zone;
-  bool invert;
-  int value;
+  JoyStick* stick;
+  JoyStick::Axis axis;
 };
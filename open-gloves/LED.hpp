@@ -27,7 +27,7 @@ class StatusLED {
         digitalWrite(pin, state = HIGH);
         break;
       case BLINK_STEADY:
-        if (millis() > last_update + 500) {
+        if (millis() - last_update > 500) {
           // Every 1 second or so invert the state of the LED.
           digitalWrite(pin, state = !state);
           last_update = millis();
@@ -50,5 +50,5 @@ class StatusLED {
  protected:
   int pin;
   bool state;
-  int last_update;
+  unsigned long last_update;
 };
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Config.h"
+
+#include "SampleTrace.hpp"
+
+// Keeps the loop within its time budget on weak hardware or stalled links.
+//
+// The time spent working in each loop (everything but the delay) is compared to
+// LOOP_BUDGET_US. After LOOP_BUDGET_OVERRUNS loops in a row over budget, optional
+// work is shed one level at a time. After LOOP_BUDGET_RECOVERY loops in a row with
+// at least half the budget to spare, it is restored one level at a time.
+class LoopBudget {
+ public:
+  enum Level : uint8_t {
+    FULL,             // Everything runs every loop.
+    SKIP_FILTERS,     // Filter stages (eg. median) are skipped.
+    REDUCE_SECONDARY, // Splay and joystick are only sampled every other loop.
+    BATCH_OUTPUT,     // Frames are only sent every other loop, or two or more per batch when batching.
+  };
+
+  static void beginLoop() {
+    loop_start = micros();
+    loop_count++;
+  }
+
+  static void endLoop() {
+    unsigned long elapsed = micros() - loop_start;
+    // Average over about 16 loops.
+    work_time += ((long)elapsed - (long)work_time) / 16;
+
+    #if ENABLE_LOOP_BUDGET
+      // Keep recordings deterministic, they need every sensor every loop.
+      if (SampleTrace::getMode() != SampleTrace::LIVE) {
+        level = FULL;
+        return;
+      }
+
+      if (elapsed > LOOP_BUDGET_US) {
+        under_count = 0;
+        if (++over_count >= LOOP_BUDGET_OVERRUNS && level < BATCH_OUTPUT) {
+          level = static_cast<Level>(level + 1);
+          over_count = 0;
+        }
+      } else if (elapsed < LOOP_BUDGET_US / 2) {
+        over_count = 0;
+        if (++under_count >= LOOP_BUDGET_RECOVERY && level > FULL) {
+          level = static_cast<Level>(level - 1);
+          under_count = 0;
+        }
+      } else {
+        over_count = under_count = 0;
+      }
+    #endif
+  }
+
+  static Level getLevel() {
+    return level;
+  }
+
+  // Average time a loop spends working (us), for all hands.
+  static unsigned long getWorkTime() {
+    return work_time;
+  }
+
+  static inline bool filtersEnabled() {
+    return level < SKIP_FILTERS;
+  }
+
+  static inline bool sampleSecondary() {
+    return level < REDUCE_SECONDARY || (loop_count & 1);
+  }
+
+  static inline bool sendOutput() {
+    return level < BATCH_OUTPUT || (loop_count & 1);
+  }
+
+  // The fewest samples per batch, batching keeps every sample and sends them
+  // less often instead.
+  static inline int minBatchSamples() {
+    return level < BATCH_OUTPUT ? 1 : 2;
+  }
+
+ private:
+  static Level level;
+  static unsigned long loop_start;
+  static unsigned long loop_count;
+  static unsigned long work_time;
+  static uint16_t over_count;
+  static uint16_t under_count;
+};
+
+LoopBudget::Level LoopBudget::level = LoopBudget::FULL;
+unsigned long LoopBudget::loop_start = 0;
+unsigned long LoopBudget::loop_count = 0;
+unsigned long LoopBudget::work_time = 0;
+uint16_t LoopBudget::over_count = 0;
+uint16_t LoopBudget::under_count = 0;
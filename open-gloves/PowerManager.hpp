@@ -0,0 +1,194 @@
+#pragma once
+
+#include "Config.h"
+
+#if ENABLE_POWER_SAVING && defined(ESP32)
+  #include <driver/gpio.h>
+  #include <driver/uart.h>
+  #include <esp_sleep.h>
+  #if CONFIG_PM_ENABLE
+    #include <esp_pm.h>
+  #endif
+  #define POWER_SAVING_ACTIVE true
+#else
+  #define POWER_SAVING_ACTIVE false
+#endif
+
+// The most buttons that can wake the glove from light sleep, every button of
+// every hand.
+#define POWER_MAX_WAKE_PINS (HAND_COUNT * BUTTON_COUNT)
+
+// Power saving for battery gloves.
+//
+// Instead of spinning in delay() the loop waits for its next deadline with the
+// CPU clock lowered, so most of the time between frames is spent idle:
+//  * If the core was built with power management (CONFIG_PM_ENABLE) the clock
+//    scales between POWER_MIN_CPU_MHZ and POWER_MAX_CPU_MHZ automatically.
+//  * If it was also built with tickless idle (CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+//    the chip light sleeps whenever every task is waiting. The timer, the radio
+//    drivers, the serial port and the buttons wake it back up. Radios keep the
+//    chip awake while they need it, so links are not affected. The stock
+//    Arduino-ESP32 core is built without tickless idle, light sleep needs a
+//    custom built core (eg. with esp32-arduino-lib-builder). Without it the
+//    clock still scales, and the wake latency only measures how late delay()
+//    returns.
+//  * Otherwise the clock is dropped to POWER_MIN_CPU_MHZ while waiting and
+//    raised back to POWER_MAX_CPU_MHZ when the deadline comes.
+//
+// Frames are scheduled on deadlines rather than a delay after the work, so the
+// frame rate does not drop as the clock changes. How late the loop wakes after
+// its deadline and the fraction of time spent working are measured, see
+// getWakeLatency() and getDutyCycle(). Without power saving, and on other
+// boards, it only waits for the deadline with delay().
+class PowerManager {
+ public:
+  static void setup() {
+    #if POWER_SAVING_ACTIVE
+      #if CONFIG_PM_ENABLE
+        #if ESP_IDF_VERSION_MAJOR >= 5
+          esp_pm_config_t config;
+        #else
+          esp_pm_config_esp32_t config;
+        #endif
+        config.max_freq_mhz = POWER_MAX_CPU_MHZ;
+        config.min_freq_mhz = POWER_MIN_CPU_MHZ;
+        config.light_sleep_enable = true;
+        light_sleep = esp_pm_configure(&config) == ESP_OK;
+        if (!light_sleep) {
+          // Without tickless idle light sleep isn't supported, keep the
+          // frequency scaling.
+          config.light_sleep_enable = false;
+        }
+        automatic = light_sleep || esp_pm_configure(&config) == ESP_OK;
+
+        if (light_sleep) {
+          // Serial data wakes the chip, the first few characters are lost.
+          esp_sleep_enable_uart_wakeup(0);
+          uart_set_wakeup_threshold(UART_NUM_0, 3);
+        }
+      #endif
+
+      if (!automatic) setCpuFrequencyMhz(POWER_MAX_CPU_MHZ);
+    #endif
+
+    next_deadline = wake_time = last_update = micros();
+  }
+
+  // Let a button wake the glove while it sleeps. Buttons sharing a pin only
+  // add it once.
+  static void addWakePin(int pin) {
+    #if POWER_SAVING_ACTIVE
+      for (uint8_t i = 0; i < wake_pin_count; i++) {
+        if (wake_pins[i] == pin) return;
+      }
+      if (wake_pin_count < POWER_MAX_WAKE_PINS) wake_pins[wake_pin_count++] = pin;
+    #endif
+  }
+
+  // Wait until period (us) after the previous deadline. If the loop already ran
+  // past it, the schedule restarts from now instead of trying to catch up.
+  static void sleep(unsigned long period) {
+    sleepUntil(next_deadline + period);
+  }
+
+  // Wait until the deadline (us). Returns false if it had already passed.
+  static bool sleepUntil(unsigned long deadline) {
+    unsigned long now = micros();
+    unsigned long active = now - wake_time;
+    next_deadline = deadline;
+
+    long remaining = (long)(deadline - now);
+    if (remaining <= 0) {
+      next_deadline = now;
+      wake_time = now;
+      updateStatistics(active, 0);
+      return false;
+    }
+
+    #if POWER_SAVING_ACTIVE
+      if (light_sleep) armWakePins();
+      if (!automatic) setCpuFrequencyMhz(POWER_MIN_CPU_MHZ);
+    #endif
+
+    // Sleep whole milliseconds so the idle task can run, the schedule absorbs
+    // the remainder on the next loop.
+    unsigned long requested = remaining / 1000 * 1000;
+    if (requested > 0) delay(requested / 1000);
+
+    #if POWER_SAVING_ACTIVE
+      if (!automatic) setCpuFrequencyMhz(POWER_MAX_CPU_MHZ);
+    #endif
+
+    wake_time = micros();
+    long late = (long)(wake_time - (now + requested));
+    updateStatistics(active, late > 0 ? late : 0);
+    return true;
+  }
+
+  // Fraction of the time spent working rather than sleeping (per mille).
+  static unsigned long getDutyCycle() {
+    return duty_cycle;
+  }
+
+  // How late the loop wakes after its deadline (us).
+  static unsigned long getWakeLatency() {
+    return wake_latency;
+  }
+
+  static unsigned long getMaxWakeLatency() {
+    return max_wake_latency;
+  }
+
+ private:
+  #if POWER_SAVING_ACTIVE
+    // Wake on any change of the buttons. Level wakeups are used because edge
+    // interrupts are not clocked in light sleep, so arm the opposite of the
+    // current level before each sleep.
+    static void armWakePins() {
+      if (wake_pin_count == 0) return;
+      for (uint8_t i = 0; i < wake_pin_count; i++) {
+        gpio_num_t pin = static_cast<gpio_num_t>(wake_pins[i]);
+        gpio_wakeup_enable(pin, digitalRead(wake_pins[i]) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+      }
+      esp_sleep_enable_gpio_wakeup();
+    }
+  #endif
+
+  static void updateStatistics(unsigned long active, unsigned long late) {
+    // Exponential moving averages with a weight of 1/16 for new samples.
+    unsigned long period = wake_time - last_update;
+    last_update = wake_time;
+    if (period == 0) return;
+
+    long sample = active >= period ? 1000 : active * 1000 / period;
+    duty_cycle += (sample - (long)duty_cycle) / 16;
+    wake_latency += ((long)late - (long)wake_latency) / 16;
+    if (late > max_wake_latency) max_wake_latency = late;
+  }
+
+  static unsigned long next_deadline;
+  static unsigned long wake_time;
+  static unsigned long last_update;
+  static unsigned long duty_cycle;
+  static unsigned long wake_latency;
+  static unsigned long max_wake_latency;
+  #if POWER_SAVING_ACTIVE
+    static bool automatic;
+    static bool light_sleep;
+    static int wake_pins[POWER_MAX_WAKE_PINS];
+    static uint8_t wake_pin_count;
+  #endif
+};
+
+unsigned long PowerManager::next_deadline = 0;
+unsigned long PowerManager::wake_time = 0;
+unsigned long PowerManager::last_update = 0;
+unsigned long PowerManager::duty_cycle = 1000;
+unsigned long PowerManager::wake_latency = 0;
+unsigned long PowerManager::max_wake_latency = 0;
+#if POWER_SAVING_ACTIVE
+  bool PowerManager::automatic = false;
+  bool PowerManager::light_sleep = false;
+  int PowerManager::wake_pins[POWER_MAX_WAKE_PINS];
+  uint8_t PowerManager::wake_pin_count = 0;
+#endif
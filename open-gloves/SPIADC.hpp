@@ -0,0 +1,209 @@
+#pragma once
+
+#include "Config.h"
+
+#if EXTERNAL_ADC != EXTERNAL_ADC_NONE
+  #if defined(ESP32)
+    #include <driver/spi_master.h>
+  #else
+    #include <SPI.h>
+  #endif
+#endif
+
+// The SPI pins can't be shared with a button.
+#define EXTERNAL_ADC_USES_PIN(pin) \
+  ((pin) == PIN_ADC_CS || (pin) == PIN_ADC_SCK || (pin) == PIN_ADC_MISO || (pin) == PIN_ADC_MOSI)
+#if EXTERNAL_ADC != EXTERNAL_ADC_NONE
+  #if EXTERNAL_ADC_USES_PIN(PIN_A_BTN) || EXTERNAL_ADC_USES_PIN(PIN_B_BTN) || \
+      EXTERNAL_ADC_USES_PIN(PIN_MENU_BTN) || EXTERNAL_ADC_USES_PIN(PIN_CALIB) || \
+      (ENABLE_JOYSTICK && EXTERNAL_ADC_USES_PIN(PIN_JOY_BTN)) || \
+      (!TRIGGER_GESTURE && EXTERNAL_ADC_USES_PIN(PIN_TRIG_BTN)) || \
+      (!GRAB_GESTURE && EXTERNAL_ADC_USES_PIN(PIN_GRAB_BTN)) || \
+      (!PINCH_GESTURE && EXTERNAL_ADC_USES_PIN(PIN_PNCH_BTN))
+    #error "A button is on one of the external ADC's SPI pins (PIN_ADC_...), move it to a free pin."
+  #endif
+#endif
+
+#if EXTERNAL_ADC == EXTERNAL_ADC_MCP3208
+  #define EXTERNAL_ADC_SPI_MODE 0
+#elif EXTERNAL_ADC == EXTERNAL_ADC_ADS8688
+  #define EXTERNAL_ADC_SPI_MODE 1
+#endif
+
+#if EXTERNAL_ADC != EXTERNAL_ADC_NONE && !defined(ESP32)
+  #define EXTERNAL_ADC_SPI_SETTINGS \
+    SPISettings(EXTERNAL_ADC_CLOCK, MSBFIRST, EXTERNAL_ADC_SPI_MODE == 0 ? SPI_MODE0 : SPI_MODE1)
+#endif
+
+// Driver for an external multi-channel SPI ADC.
+//
+// All EXTERNAL_ADC_CHANNELS channels are converted in one burst per loop by
+// sample(), and read() only returns the stored result. On ESP32 the conversions
+// are queued on the SPI driver together, which starts each one from its
+// interrupt as soon as the previous one finished with the hardware toggling chip
+// select between them. The frames are only a few bytes, so they are sent from
+// the transaction itself instead of through DMA. Elsewhere they run back to
+// back inside a single SPI transaction. Results are scaled to 0 to ANALOG_MAX
+// so they can be mixed with the built in ADC pins.
+//
+// MCP3208: one 3 byte frame per channel, the result is in the same frame.
+// ADS8688: one 4 byte frame per channel plus one, the result of a channel is
+//          in the frame after the one that selected it.
+class ExternalADC {
+ public:
+  static void setup() {
+    #if EXTERNAL_ADC != EXTERNAL_ADC_NONE
+      for (int frame = 0; frame < FRAME_COUNT; frame++) {
+        buildCommand(frame, tx[frame]);
+      }
+
+      #if defined(ESP32)
+        spi_bus_config_t bus = {};
+        bus.mosi_io_num = PIN_ADC_MOSI;
+        bus.miso_io_num = PIN_ADC_MISO;
+        bus.sclk_io_num = PIN_ADC_SCK;
+        bus.quadwp_io_num = -1;
+        bus.quadhd_io_num = -1;
+        spi_bus_initialize(SPI2_HOST, &bus, SPI_DMA_DISABLED);
+
+        spi_device_interface_config_t device_config = {};
+        device_config.clock_speed_hz = EXTERNAL_ADC_CLOCK;
+        device_config.mode = EXTERNAL_ADC_SPI_MODE;
+        device_config.spics_io_num = PIN_ADC_CS;
+        device_config.queue_size = FRAME_COUNT;
+        spi_bus_add_device(SPI2_HOST, &device_config, &device);
+
+        // Frames fit in the transaction itself, no separate buffers needed.
+        for (int frame = 0; frame < FRAME_COUNT; frame++) {
+          transactions[frame] = {};
+          transactions[frame].flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+          transactions[frame].length = FRAME_SIZE * 8;
+          memcpy(transactions[frame].tx_data, tx[frame], FRAME_SIZE);
+        }
+      #else
+        pinMode(PIN_ADC_CS, OUTPUT);
+        digitalWrite(PIN_ADC_CS, HIGH);
+        SPI.begin();
+      #endif
+
+      #if EXTERNAL_ADC == EXTERNAL_ADC_ADS8688
+        // Set the input range of every channel.
+        for (int channel = 0; channel < EXTERNAL_ADC_CHANNELS; channel++) {
+          uint16_t command = ((0x05 + channel) << 9) | (1 << 8) | ADS8688_RANGE;
+          uint8_t frame[FRAME_SIZE] = {(uint8_t)(command >> 8), (uint8_t)command, 0, 0};
+          transfer(frame);
+        }
+      #endif
+    #endif
+  }
+
+  // Convert every channel. Call once per loop before the inputs are read.
+  static void sample() {
+    #if EXTERNAL_ADC != EXTERNAL_ADC_NONE
+      #if defined(ESP32)
+        spi_device_acquire_bus(device, portMAX_DELAY);
+        for (int frame = 0; frame < FRAME_COUNT; frame++) {
+          spi_device_queue_trans(device, &transactions[frame], portMAX_DELAY);
+        }
+        for (int frame = 0; frame < FRAME_COUNT; frame++) {
+          spi_transaction_t* done;
+          spi_device_get_trans_result(device, &done, portMAX_DELAY);
+        }
+        spi_device_release_bus(device);
+
+        for (int frame = 0; frame < FRAME_COUNT; frame++) {
+          decode(frame, transactions[frame].rx_data);
+        }
+      #else
+        SPI.beginTransaction(EXTERNAL_ADC_SPI_SETTINGS);
+        for (int frame = 0; frame < FRAME_COUNT; frame++) {
+          uint8_t data[FRAME_SIZE];
+          memcpy(data, tx[frame], FRAME_SIZE);
+          digitalWrite(PIN_ADC_CS, LOW);
+          SPI.transfer(data, FRAME_SIZE);
+          digitalWrite(PIN_ADC_CS, HIGH);
+          decode(frame, data);
+        }
+        SPI.endTransaction();
+      #endif
+    #endif
+  }
+
+  static inline int read(int channel) {
+    return values[channel];
+  }
+
+ private:
+  #if EXTERNAL_ADC == EXTERNAL_ADC_MCP3208
+    static constexpr int FRAME_SIZE = 3;
+    static constexpr int FRAME_COUNT = EXTERNAL_ADC_CHANNELS;
+    static constexpr int BITS = 12;
+
+    // Start bit, single ended, then the channel.
+    static void buildCommand(int frame, uint8_t* command) {
+      command[0] = 0x06 | (frame >> 2);
+      command[1] = (frame & 0x03) << 6;
+      command[2] = 0;
+    }
+
+    static void decode(int frame, const uint8_t* data) {
+      values[frame] = scale(((data[1] & 0x0F) << 8) | data[2]);
+    }
+  #elif EXTERNAL_ADC == EXTERNAL_ADC_ADS8688
+    static constexpr int FRAME_SIZE = 4;
+    static constexpr int FRAME_COUNT = EXTERNAL_ADC_CHANNELS + 1;
+    static constexpr int BITS = 16;
+
+    // Manual channel select, the last frame is a no-op to clock out the result.
+    static void buildCommand(int frame, uint8_t* command) {
+      uint16_t select = frame < EXTERNAL_ADC_CHANNELS ? 0xC000 | (frame << 10) : 0x0000;
+      command[0] = select >> 8;
+      command[1] = select & 0xFF;
+      command[2] = 0;
+      command[3] = 0;
+    }
+
+    static void decode(int frame, const uint8_t* data) {
+      if (frame > 0) values[frame - 1] = scale((data[2] << 8) | data[3]);
+    }
+  #endif
+
+  #if EXTERNAL_ADC != EXTERNAL_ADC_NONE
+    static inline int scale(uint32_t raw) {
+      return (raw * (ANALOG_MAX + 1UL)) >> BITS;
+    }
+
+    static void transfer(uint8_t* frame) {
+      #if defined(ESP32)
+        spi_transaction_t transaction = {};
+        transaction.flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+        transaction.length = FRAME_SIZE * 8;
+        memcpy(transaction.tx_data, frame, FRAME_SIZE);
+        spi_device_polling_transmit(device, &transaction);
+      #else
+        SPI.beginTransaction(EXTERNAL_ADC_SPI_SETTINGS);
+        digitalWrite(PIN_ADC_CS, LOW);
+        SPI.transfer(frame, FRAME_SIZE);
+        digitalWrite(PIN_ADC_CS, HIGH);
+        SPI.endTransaction();
+      #endif
+    }
+
+    static uint8_t tx[FRAME_COUNT][FRAME_SIZE];
+    #if defined(ESP32)
+      static spi_device_handle_t device;
+      static spi_transaction_t transactions[FRAME_COUNT];
+    #endif
+  #endif
+
+  static uint16_t values[EXTERNAL_ADC_CHANNELS];
+};
+
+uint16_t ExternalADC::values[EXTERNAL_ADC_CHANNELS];
+#if EXTERNAL_ADC != EXTERNAL_ADC_NONE
+  uint8_t ExternalADC::tx[ExternalADC::FRAME_COUNT][ExternalADC::FRAME_SIZE];
+  #if defined(ESP32)
+    spi_device_handle_t ExternalADC::device;
+    spi_transaction_t ExternalADC::transactions[ExternalADC::FRAME_COUNT];
+  #endif
+#endif
@@ -0,0 +1,366 @@
+#pragma once
+
+#include "Config.h"
+
+#include "AnalogSource.hpp"
+#include "DriverProtocol.hpp"
+#include "ICommunication.hpp"
+
+#if ENABLE_RECORDING && RECORD_SINK == RECORD_SINK_FLASH
+  #if !defined(ESP32)
+    #error "Recording to flash is only supported on ESP32, use RECORD_SINK_COMM instead."
+  #endif
+  #if RECORD_FLUSH_BYTES < 4 + RECORD_MAX_CHANNELS * 2
+    #error "RECORD_FLUSH_BYTES must hold at least one record."
+  #endif
+  #include <LittleFS.h>
+#endif
+
+// Records the raw, pre-calibration samples of every input so real captured
+// motion can be replayed through the calibrators, filters and gestures later.
+//
+// Inputs read their sensors through SampleTrace::analog() and SampleTrace::digital(),
+// buttons pass the raw pin level so replays go through the debouncing again.
+// While recording, every value read in a loop is stored as one record along with
+// the time it was taken. While replaying, the values come from the recording
+// instead of the hardware, in the same order they were read, and each record is
+// held until the loop reaches the time it was recorded at.
+//
+// With RECORD_SINK_FLASH records are stored in a ring on LittleFS so the most
+// recent RECORD_MAX_BYTES are kept. Each record is a 32 bit timestamp (us since
+// recording started) followed by a 16 bit value per channel. The records are
+// collected in RAM and written in blocks of RECORD_FLUSH_BYTES by flush(), which
+// the loop calls once the frames are sent. With RECORD_SINK_COMM each record is
+// sent out the communication channel as it is taken instead.
+//
+// host-test/replay.cpp runs a dumped recording through the firmware on a PC.
+//
+// Commands from the driver channel:
+//   (RS) start recording   (RE) stop recording or replaying
+//   (RP) replay the recording once, then return to the live sensors
+//   (RD) dump the recording as text, one record per line:
+//        (RD)<time us>:<value>,<value>,...\n followed by (RD)END\n
+class SampleTrace {
+ public:
+  enum Mode : uint8_t {
+    LIVE,
+    RECORDING,
+    REPLAYING
+  };
+
+  static void setup() {
+    #if ENABLE_RECORDING && RECORD_SINK == RECORD_SINK_FLASH
+      LittleFS.begin(true);
+    #endif
+  }
+
+  static inline int analog(int pin) {
+    #if ENABLE_RECORDING
+      if (mode == REPLAYING) return replayNext();
+      int value = AnalogSource::read(pin);
+      record(value);
+      return value;
+    #else
+      return AnalogSource::read(pin);
+    #endif
+  }
+
+  static inline bool digital(bool level) {
+    #if ENABLE_RECORDING
+      if (mode == REPLAYING) return replayNext() != 0;
+      record(level);
+    #endif
+    return level;
+  }
+
+  static Mode getMode() {
+    return mode;
+  }
+
+  // The time the inputs of this loop are read at.
+  static unsigned long frameTime() {
+    #if ENABLE_RECORDING
+      return frame_time;
+    #else
+      return micros();
+    #endif
+  }
+
+  #if ENABLE_RECORDING
+    // Call before the inputs are read each loop.
+    static void beginFrame(unsigned long time) {
+      channel = 0;
+      if (mode == REPLAYING) pace(time);
+      frame_time = time;
+    }
+
+    // Call after the inputs are read each loop.
+    static void endFrame(ICommunication* comm) {
+      if (mode != RECORDING) return;
+
+      // The first frame decides how many channels each record holds.
+      if (channels == 0) {
+        channels = min(channel, RECORD_MAX_CHANNELS);
+        #if RECORD_SINK == RECORD_SINK_FLASH
+          header.capacity = (RECORD_MAX_BYTES - HEADER_SIZE) / recordSize();
+          header.channels = channels;
+        #endif
+      }
+
+      #if RECORD_SINK == RECORD_SINK_FLASH
+        // Only write in the loop if flush() didn't keep up.
+        if (buffered + recordSize() > RECORD_FLUSH_BYTES) writeBuffer();
+        bufferRecord();
+      #else
+        sendRecord(comm);
+      #endif
+    }
+
+    // Write the collected records to flash once a block is full. Call once the
+    // frames were sent so the writes don't delay them.
+    static void flush() {
+      #if RECORD_SINK == RECORD_SINK_FLASH
+        if (mode == RECORDING && buffered + recordSize() > RECORD_FLUSH_BYTES) writeBuffer();
+      #endif
+    }
+
+    // Handle recording commands. Returns true if the message was consumed.
+    static bool handle(ICommunication* comm, const char* input) {
+      if (strncmp(input, "(RS)", 4) == 0) {
+        start();
+      } else if (strncmp(input, "(RE)", 4) == 0) {
+        stop();
+      } else if (strncmp(input, "(RP)", 4) == 0) {
+        replay();
+      } else if (strncmp(input, "(RD)", 4) == 0) {
+        dump(comm);
+      } else {
+        return false;
+      }
+      return true;
+    }
+  #endif
+
+ private:
+  static constexpr uint32_t MAGIC = 0x4F475452; // "OGTR"
+
+  // Stored at the start of the file, followed by the ring of records.
+  struct Header {
+    uint32_t magic;
+    uint32_t capacity; // Records that fit in the ring.
+    uint32_t head;     // Total records written, the next one goes to head % capacity.
+    uint32_t count;    // Records currently stored.
+    uint16_t channels;
+    uint16_t reserved;
+  };
+  static constexpr int HEADER_SIZE = sizeof(Header);
+
+  #if ENABLE_RECORDING
+    static int recordSize() {
+      return sizeof(uint32_t) + channels * sizeof(uint16_t);
+    }
+
+    static void record(int value) {
+      if (mode == RECORDING && channel < RECORD_MAX_CHANNELS) values[channel] = value;
+      channel++;
+    }
+
+    static int replayNext() {
+      return channel < channels ? values[channel++] : 0;
+    }
+
+    // Move on to the next record once the loop reached the time it was
+    // recorded at, the loop may run faster or slower than it did then.
+    static void pace(unsigned long time) {
+      uint32_t next_time;
+      if (!peekTime(next_time)) {
+        stop();
+        return;
+      }
+      if (replay_index == 0) replay_offset = time - next_time;
+      if ((long)(time - replay_offset - next_time) >= 0) loadRecord();
+    }
+
+    static void start() {
+      stop();
+      channels = 0;
+      start_time = micros();
+      #if RECORD_SINK == RECORD_SINK_FLASH
+        buffered = 0;
+      #endif
+      #if RECORD_SINK == RECORD_SINK_FLASH
+        file = LittleFS.open(RECORD_FILE, "w+");
+        if (!file) return;
+        header.magic = MAGIC;
+        header.capacity = 0;
+        header.head = 0;
+        header.count = 0;
+        header.channels = 0;
+        header.reserved = 0;
+        writeHeader();
+      #endif
+      mode = RECORDING;
+    }
+
+    static void stop() {
+      #if RECORD_SINK == RECORD_SINK_FLASH
+        if (mode == RECORDING) writeBuffer();
+        if (file) file.close();
+      #endif
+      mode = LIVE;
+    }
+
+    static void replay() {
+      #if RECORD_SINK == RECORD_SINK_FLASH
+        stop();
+        if (!openRecording()) return;
+        replay_index = 0;
+        mode = REPLAYING;
+      #endif
+    }
+
+    static void dump(ICommunication* comm) {
+      #if RECORD_SINK == RECORD_SINK_FLASH
+        stop();
+        if (openRecording()) {
+          for (replay_index = 0; loadRecord();) {
+            sendRecord(comm);
+          }
+          file.close();
+        }
+      #endif
+      comm->output((char*)"(RD)END\n");
+    }
+
+    static void sendRecord(ICommunication* comm) {
+      char line[4 + 10 + 1 + RECORD_MAX_CHANNELS * 6 + 2];
+      int length = snprintf(line, sizeof(line), "(RD)%lu:", frame_time - start_time);
+      for (int i = 0; i < channels; i++) {
+        length += snprintf(line + length, sizeof(line) - length, i == 0 ? "%d" : ",%d", values[i]);
+      }
+      line[length++] = '\n';
+      line[length] = '\0';
+      comm->output(line);
+    }
+
+    #if RECORD_SINK == RECORD_SINK_FLASH
+      static void writeHeader() {
+        file.seek(0);
+        file.write((const uint8_t*)&header, sizeof(header));
+      }
+
+      static void bufferRecord() {
+        uint32_t time = frame_time - start_time;
+        memcpy(buffer + buffered, &time, sizeof(time));
+        memcpy(buffer + buffered + sizeof(time), values, channels * sizeof(uint16_t));
+        buffered += recordSize();
+      }
+
+      // Write the buffered records to the ring, in at most two pieces when the
+      // ring wraps, and persist the header with them.
+      static void writeBuffer() {
+        uint32_t records = buffered / recordSize();
+        uint32_t offset = 0;
+        while (records > 0) {
+          uint32_t slot = header.head % header.capacity;
+          uint32_t count = min(records, header.capacity - slot);
+          file.seek(HEADER_SIZE + slot * recordSize());
+          file.write(buffer + offset, count * recordSize());
+          offset += count * recordSize();
+          records -= count;
+          header.head += count;
+          header.count = min(header.count + count, header.capacity);
+        }
+        buffered = 0;
+        writeHeader();
+      }
+
+      static bool openRecording() {
+        file = LittleFS.open(RECORD_FILE, "r");
+        if (!file) return false;
+
+        file.read((uint8_t*)&header, sizeof(header));
+        channels = header.channels;
+
+        if (header.magic != MAGIC || header.capacity == 0 || channels > RECORD_MAX_CHANNELS) {
+          file.close();
+          return false;
+        }
+
+        // Never read past the end of a file that was cut short.
+        uint32_t stored = (file.size() - HEADER_SIZE) / recordSize();
+        if (stored < header.count) header.count = stored;
+        return true;
+      }
+
+      static uint32_t recordOffset(uint32_t index) {
+        uint32_t oldest = header.head - header.count;
+        return HEADER_SIZE + ((oldest + index) % header.capacity) * recordSize();
+      }
+
+      // Load the next record of the recording, oldest first.
+      static bool loadRecord() {
+        channel = 0;
+        if (replay_index >= header.count) return false;
+
+        file.seek(recordOffset(replay_index++));
+        uint32_t time = 0;
+        file.read((uint8_t*)&time, sizeof(time));
+        file.read((uint8_t*)values, channels * sizeof(uint16_t));
+        frame_time = start_time + time;
+        return true;
+      }
+
+      // The time of the next record, without loading it.
+      static bool peekTime(uint32_t& time) {
+        if (replay_index >= header.count) return false;
+        file.seek(recordOffset(replay_index));
+        file.read((uint8_t*)&time, sizeof(time));
+        return true;
+      }
+
+      static File file;
+      static Header header;
+      static uint32_t replay_index;
+      static unsigned long replay_offset;
+      static uint8_t buffer[RECORD_FLUSH_BYTES];
+      static size_t buffered;
+    #else
+      static bool loadRecord() {
+        return false;
+      }
+
+      static bool peekTime(uint32_t& time) {
+        return false;
+      }
+
+      static constexpr uint32_t replay_index = 0;
+      static unsigned long replay_offset;
+    #endif
+
+    static uint16_t values[RECORD_MAX_CHANNELS];
+    static int channels;
+    static int channel;
+    static unsigned long frame_time;
+    static unsigned long start_time;
+  #endif
+
+  static Mode mode;
+};
+
+SampleTrace::Mode SampleTrace::mode = SampleTrace::LIVE;
+#if ENABLE_RECORDING
+  uint16_t SampleTrace::values[RECORD_MAX_CHANNELS];
+  int SampleTrace::channels = 0;
+  int SampleTrace::channel = 0;
+  unsigned long SampleTrace::frame_time = 0;
+  unsigned long SampleTrace::start_time = 0;
+  #if RECORD_SINK == RECORD_SINK_FLASH
+    File SampleTrace::file;
+    SampleTrace::Header SampleTrace::header;
+    uint32_t SampleTrace::replay_index = 0;
+    uint8_t SampleTrace::buffer[RECORD_FLUSH_BYTES];
+    size_t SampleTrace::buffered = 0;
+  #endif
+  unsigned long SampleTrace::replay_offset = 0;
+#endif
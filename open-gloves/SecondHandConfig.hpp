@@ -0,0 +1,199 @@
+#pragma once
+#include "Config.h"
+
+// The second hand of a dual hand board (See ENABLE_DUAL_HAND), the same
+// hardware as in HardwareConfig.hpp on the PIN_..._2 pins.
+
+#if !defined(ESP32)
+  #error "ENABLE_DUAL_HAND needs an ESP32."
+#endif
+#if EXTERNAL_ADC == EXTERNAL_ADC_NONE && PIN_INDEX_2 >= EXTERNAL_ADC_PIN_BASE
+  #error "The second hand's fingers are on the external ADC, set EXTERNAL_ADC or change the PIN_..._2 pins."
+#endif
+
+// The second hand's digital pins must be set, free and not 0 (boot strapping),
+// 1 or 3 (serial).
+#define FIRST_HAND_USES_PIN(pin) \
+  ((pin) == PIN_A_BTN || (pin) == PIN_B_BTN || (pin) == PIN_MENU_BTN || (pin) == PIN_CALIB || \
+   (ENABLE_JOYSTICK && (pin) == PIN_JOY_BTN) || (!TRIGGER_GESTURE && (pin) == PIN_TRIG_BTN) || \
+   (!GRAB_GESTURE && (pin) == PIN_GRAB_BTN) || (!PINCH_GESTURE && (pin) == PIN_PNCH_BTN) || \
+   (ENABLE_FORCE_FEEDBACK && ((pin) == PIN_PINKY_FFB || (pin) == PIN_RING_FFB || (pin) == PIN_MIDDLE_FFB || \
+                              (pin) == PIN_INDEX_FFB || (ENABLE_THUMB && (pin) == PIN_THUMB_FFB))) || \
+   (ENABLE_HAPTICS && (pin) == PIN_HAPTIC) || (pin) == PIN_LED)
+#define SECOND_HAND_PIN_UNUSABLE(pin) \
+  ((pin) < 0 || (pin) == 0 || (pin) == 1 || (pin) == 3 || FIRST_HAND_USES_PIN(pin) || IMU_USES_PIN(pin) || \
+   (EXTERNAL_ADC != EXTERNAL_ADC_NONE && EXTERNAL_ADC_USES_PIN(pin)))
+
+// How many of the second hand's enabled buttons and outputs are on the pin.
+#define SECOND_HAND_BUTTONS_ON(pin) \
+  (((pin) == PIN_A_BTN_2) + ((pin) == PIN_B_BTN_2) + ((pin) == PIN_MENU_BTN_2) + ((pin) == PIN_CALIB_2) + \
+   (ENABLE_JOYSTICK && (pin) == PIN_JOY_BTN_2) + (!TRIGGER_GESTURE && (pin) == PIN_TRIG_BTN_2) + \
+   (!GRAB_GESTURE && (pin) == PIN_GRAB_BTN_2) + (!PINCH_GESTURE && (pin) == PIN_PNCH_BTN_2))
+#define SECOND_HAND_OUTPUTS_ON(pin) \
+  ((ENABLE_FORCE_FEEDBACK && (pin) == PIN_PINKY_FFB_2) + (ENABLE_FORCE_FEEDBACK && (pin) == PIN_RING_FFB_2) + \
+   (ENABLE_FORCE_FEEDBACK && (pin) == PIN_MIDDLE_FFB_2) + (ENABLE_FORCE_FEEDBACK && (pin) == PIN_INDEX_FFB_2) + \
+   (ENABLE_FORCE_FEEDBACK && ENABLE_THUMB && (pin) == PIN_THUMB_FFB_2) + (ENABLE_HAPTICS && (pin) == PIN_HAPTIC_2))
+#define SECOND_HAND_PIN_SHARED(pin) (SECOND_HAND_BUTTONS_ON(pin) + SECOND_HAND_OUTPUTS_ON(pin) > 1)
+
+#if SECOND_HAND_PIN_SHARED(PIN_A_BTN_2) || SECOND_HAND_PIN_SHARED(PIN_B_BTN_2) || \
+    SECOND_HAND_PIN_SHARED(PIN_MENU_BTN_2) || SECOND_HAND_PIN_SHARED(PIN_CALIB_2) || \
+    (ENABLE_JOYSTICK && SECOND_HAND_PIN_SHARED(PIN_JOY_BTN_2)) || \
+    (!TRIGGER_GESTURE && SECOND_HAND_PIN_SHARED(PIN_TRIG_BTN_2)) || \
+    (!GRAB_GESTURE && SECOND_HAND_PIN_SHARED(PIN_GRAB_BTN_2)) || \
+    (!PINCH_GESTURE && SECOND_HAND_PIN_SHARED(PIN_PNCH_BTN_2))
+  #error "Two of the second hand's buttons or outputs are on the same pin, give each its own PIN_..._2 pin."
+#endif
+#if SECOND_HAND_PIN_UNUSABLE(PIN_A_BTN_2) || SECOND_HAND_PIN_UNUSABLE(PIN_B_BTN_2) || \
+    SECOND_HAND_PIN_UNUSABLE(PIN_MENU_BTN_2) || SECOND_HAND_PIN_UNUSABLE(PIN_CALIB_2) || \
+    (ENABLE_JOYSTICK && SECOND_HAND_PIN_UNUSABLE(PIN_JOY_BTN_2)) || \
+    (!TRIGGER_GESTURE && SECOND_HAND_PIN_UNUSABLE(PIN_TRIG_BTN_2)) || \
+    (!GRAB_GESTURE && SECOND_HAND_PIN_UNUSABLE(PIN_GRAB_BTN_2)) || \
+    (!PINCH_GESTURE && SECOND_HAND_PIN_UNUSABLE(PIN_PNCH_BTN_2))
+  #error "A button of the second hand isn't set or its pin is taken, move its PIN_..._BTN_2 or PIN_CALIB_2 to a free pin."
+#endif
+#if ENABLE_FORCE_FEEDBACK && \
+    (SECOND_HAND_PIN_UNUSABLE(PIN_PINKY_FFB_2) || SECOND_HAND_PIN_UNUSABLE(PIN_RING_FFB_2) || \
+     SECOND_HAND_PIN_UNUSABLE(PIN_MIDDLE_FFB_2) || SECOND_HAND_PIN_UNUSABLE(PIN_INDEX_FFB_2) || \
+     (ENABLE_THUMB && SECOND_HAND_PIN_UNUSABLE(PIN_THUMB_FFB_2)) || \
+     SECOND_HAND_PIN_SHARED(PIN_PINKY_FFB_2) || SECOND_HAND_PIN_SHARED(PIN_RING_FFB_2) || \
+     SECOND_HAND_PIN_SHARED(PIN_MIDDLE_FFB_2) || SECOND_HAND_PIN_SHARED(PIN_INDEX_FFB_2) || \
+     (ENABLE_THUMB && SECOND_HAND_PIN_SHARED(PIN_THUMB_FFB_2)))
+  #error "The second hand's force feedback needs its own free pins, set the PIN_..._FFB_2 pins."
+#endif
+#if ENABLE_HAPTICS && (SECOND_HAND_PIN_UNUSABLE(PIN_HAPTIC_2) || SECOND_HAND_PIN_SHARED(PIN_HAPTIC_2))
+  #error "The second hand's haptic motor needs its own free pin, set PIN_HAPTIC_2."
+#endif
+
+Button calibration_button_2(EncodedInput::Type::CALIBRATE, PIN_CALIB_2, INVERT_CALIB);
+
+Button* buttons_2[BUTTON_COUNT] = {
+  new Button(EncodedInput::Type::A_BTN, PIN_A_BTN_2, INVERT_A),
+  new Button(EncodedInput::Type::B_BTN, PIN_B_BTN_2, INVERT_B),
+  new Button(EncodedInput::Type::MENU, PIN_MENU_BTN_2, INVERT_MENU),
+  &calibration_button_2,
+  #if ENABLE_JOYSTICK
+    new Button(EncodedInput::Type::JOY_BTN, PIN_JOY_BTN_2, INVERT_JOY),
+  #endif
+  #if !TRIGGER_GESTURE
+    new Button(EncodedInput::Type::TRIGGER, PIN_TRIG_BTN_2, INVERT_TRIGGER),
+  #endif
+  #if !GRAB_GESTURE
+    new Button(EncodedInput::Type::GRAB, PIN_GRAB_BTN_2, INVERT_GRAB),
+  #endif
+  #if !PINCH_GESTURE
+    new Button(EncodedInput::Type::PINCH, PIN_PNCH_BTN_2, INVERT_PINCH),
+  #endif
+};
+
+#if !ENABLE_SPLAY
+  #if ENABLE_THUMB
+    Finger finger_thumb_2(EncodedInput::Type::THUMB, PIN_THUMB_2);
+  #endif
+  Finger finger_index_2(EncodedInput::Type::INDEX, PIN_INDEX_2);
+  Finger finger_middle_2(EncodedInput::Type::MIDDLE, PIN_MIDDLE_2);
+  Finger finger_ring_2(EncodedInput::Type::RING, PIN_RING_2);
+  Finger finger_pinky_2(EncodedInput::Type::PINKY, PIN_PINKY_2);
+#else
+  #if ENABLE_THUMB
+    SplayFinger finger_thumb_2(EncodedInput::Type::THUMB, PIN_THUMB_2, PIN_THUMB_SPLAY_2);
+  #endif
+  SplayFinger finger_index_2(EncodedInput::Type::INDEX, PIN_INDEX_2, PIN_INDEX_SPLAY_2);
+  SplayFinger finger_middle_2(EncodedInput::Type::MIDDLE, PIN_MIDDLE_2, PIN_MIDDLE_SPLAY_2);
+  SplayFinger finger_ring_2(EncodedInput::Type::RING, PIN_RING_2, PIN_RING_SPLAY_2);
+  SplayFinger finger_pinky_2(EncodedInput::Type::PINKY, PIN_PINKY_2, PIN_PINKY_SPLAY_2);
+#endif
+
+Finger* fingers_2[FINGER_COUNT] = {
+  #if ENABLE_THUMB
+    &finger_thumb_2,
+  #endif
+  &finger_index_2, &finger_middle_2, &finger_ring_2, &finger_pinky_2
+};
+
+#if ENABLE_JOYSTICK
+  JoyStick joystick_2(PIN_JOY_X_2, PIN_JOY_Y_2, true);
+#endif
+
+JoyStick* sticks_2[STICK_COUNT] = {
+  #if ENABLE_JOYSTICK
+    &joystick_2
+  #endif
+};
+
+JoyStickAxis* joysticks_2[JOYSTICK_COUNT] = {
+  #if ENABLE_JOYSTICK
+    new JoyStickAxis(EncodedInput::Type::JOY_X, &joystick_2, JoyStick::X),
+    new JoyStickAxis(EncodedInput::Type::JOY_Y, &joystick_2, JoyStick::Y)
+  #endif
+};
+
+IMUInput* imus_2[IMU_COUNT] = {
+  #if ENABLE_IMU
+    new IMUInput(EncodedInput::Type::ORIENTATION, IMU_I2C_ADDRESS_2)
+  #endif
+};
+
+// The fingers in the order gesture rules list their weights.
+Finger* hand_2[5] = {
+  #if ENABLE_THUMB
+    &finger_thumb_2,
+  #else
+    NULL,
+  #endif
+  &finger_index_2, &finger_middle_2, &finger_ring_2, &finger_pinky_2
+};
+
+Gesture* gestures_2[GESTURE_COUNT] = {
+  #if TRIGGER_GESTURE
+    new RuleGesture(GestureRule TRIGGER_GESTURE_RULE, hand_2),
+  #endif
+  #if GRAB_GESTURE
+    new RuleGesture(GestureRule GRAB_GESTURE_RULE, hand_2),
+  #endif
+  #if PINCH_GESTURE
+    new RuleGesture(GestureRule PINCH_GESTURE_RULE, hand_2),
+  #endif
+};
+
+// The empty rule at the end lets the list of custom rules be empty.
+const GestureRule custom_gesture_rules_2[] = { CUSTOM_GESTURE_RULES_2 {} };
+#define CUSTOM_GESTURE_COUNT_2 (sizeof(custom_gesture_rules_2) / sizeof(GestureRule) - 1)
+Gesture** custom_gestures_2 = createRuleGestures(custom_gesture_rules_2, CUSTOM_GESTURE_COUNT_2, hand_2);
+
+HapticMotor* haptics_2[HAPTIC_COUNT] = {
+  #if ENABLE_HAPTICS
+    new HapticMotor(DecodedOuput::Type::HAPTIC_FREQ,
+                    DecodedOuput::Type::HAPTIC_DURATION,
+                    DecodedOuput::Type::HAPTIC_AMPLITUDE, PIN_HAPTIC_2),
+  #endif
+};
+
+ForceFeedback* force_feedbacks_2[FORCE_FEEDBACK_COUNT] {
+  #if ENABLE_FORCE_FEEDBACK
+    #if FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_SERVO
+      #if ENABLE_THUMB
+        new ServoForceFeedback(DecodedOuput::Type::FFB_THUMB, &finger_thumb_2, PIN_THUMB_FFB_2, FORCE_FEEDBACK_INVERT),
+      #endif
+      new ServoForceFeedback(DecodedOuput::Type::FFB_INDEX, &finger_index_2, PIN_INDEX_FFB_2, FORCE_FEEDBACK_INVERT),
+      new ServoForceFeedback(DecodedOuput::Type::FFB_MIDDLE, &finger_middle_2, PIN_MIDDLE_FFB_2, FORCE_FEEDBACK_INVERT),
+      new ServoForceFeedback(DecodedOuput::Type::FFB_RING, &finger_ring_2, PIN_RING_FFB_2, FORCE_FEEDBACK_INVERT),
+      new ServoForceFeedback(DecodedOuput::Type::FFB_PINKY, &finger_pinky_2, PIN_PINKY_FFB_2, FORCE_FEEDBACK_INVERT)
+    #elif FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_CLAMP
+      #if ENABLE_THUMB
+        new DigitalClampForceFeedback(DecodedOuput::Type::FFB_THUMB, &finger_thumb_2, PIN_THUMB_FFB_2),
+      #endif
+      new DigitalClampForceFeedback(DecodedOuput::Type::FFB_INDEX, &finger_index_2, PIN_INDEX_FFB_2),
+      new DigitalClampForceFeedback(DecodedOuput::Type::FFB_MIDDLE, &finger_middle_2, PIN_MIDDLE_FFB_2),
+      new DigitalClampForceFeedback(DecodedOuput::Type::FFB_RING, &finger_ring_2, PIN_RING_FFB_2),
+      new DigitalClampForceFeedback(DecodedOuput::Type::FFB_PINKY, &finger_pinky_2, PIN_PINKY_FFB_2)
+    #elif FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_SERVO_CLAMP
+      #if ENABLE_THUMB
+        new ServoClampForceFeedback(DecodedOuput::Type::FFB_THUMB, &finger_thumb_2, PIN_THUMB_FFB_2),
+      #endif
+      new ServoClampForceFeedback(DecodedOuput::Type::FFB_INDEX, &finger_index_2, PIN_INDEX_FFB_2),
+      new ServoClampForceFeedback(DecodedOuput::Type::FFB_MIDDLE, &finger_middle_2, PIN_MIDDLE_FFB_2),
+      new ServoClampForceFeedback(DecodedOuput::Type::FFB_RING, &finger_ring_2, PIN_RING_FFB_2),
+      new ServoClampForceFeedback(DecodedOuput::Type::FFB_PINKY, &finger_pinky_2, PIN_PINKY_FFB_2)
+    #endif
+  #endif
+};
@@ -3,13 +3,35 @@
 #include "Config.h"
 #include "ICommunication.hpp"
 
+// Serial starts at the safe SERIAL_BAUD_RATE. The driver can then negotiate a
+// faster rate:
+//   driver:   (BR)<requested baud>\n
+//   firmware: (BA)<accepted baud>\n   the highest rate both support, then switches
+//   driver:   (BV)<token>\n           sent at the new rate
+//   firmware: (BV)<token>\n           echoed at the new rate
+// If the verification doesn't arrive within SERIAL_BAUD_VERIFY_TIMEOUT, or
+// SERIAL_BAUD_MAX_ERRORS corrupted lines arrive in a row, the firmware falls back
+// to SERIAL_BAUD_RATE. It announces the fallback at the old rate first:
+//   firmware: (BA)<SERIAL_BAUD_RATE>\n  then switches
+// The driver switches back when it reads this. If the link is too broken for
+// the announcement to get through, the driver should fall back on its own once
+// it stops receiving valid frames for longer than SERIAL_BAUD_VERIFY_TIMEOUT,
+// and negotiate again.
 class SerialCommunication : public ICommunication {
   private:
     bool m_isOpen;
+    unsigned long m_baudRate;
+    bool m_verifying;
+    unsigned long m_switchTime;
+    int m_errors;
 
   public:
     SerialCommunication() {
       m_isOpen = false;
+      m_baudRate = SERIAL_BAUD_RATE;
+      m_verifying = false;
+      m_switchTime = 0;
+      m_errors = 0;
     }
 
     bool isOpen(){
@@ -18,22 +40,100 @@ class SerialCommunication : public ICommunication {
 
     void start(){
       Serial.setTimeout(ENABLE_SYNCHRONOUS_COMM ? 10000 : 4);
+      #if defined(ESP32)
+        // Both hands' frames fit without waiting for the wire.
+        Serial.setTxBufferSize(SERIAL_TX_BUFFER);
+      #endif
       Serial.begin(SERIAL_BAUD_RATE);
       m_isOpen = true;
     }
 
+    // The frame is left in the transmit buffer. Waiting for it to go out
+    // would add its wire time to the loop, twice with two hands.
     void output(char* data){
       Serial.print(data);
-      Serial.flush();
     }
 
     bool hasData() {
+      checkVerification();
       return Serial.available() > 0;
     }
 
     bool readData(char* input, size_t buffer_size){
+      checkVerification();
       size_t size = Serial.readBytesUntil('\n', input, buffer_size);
       input[size] = '\0';
-      return size > 0;
+      if (size == 0) return false;
+
+      if (isCorrupted(input, size)) {
+        // Garbage at a raised baud rate means the link can't handle it.
+        if (m_baudRate != SERIAL_BAUD_RATE && ++m_errors >= SERIAL_BAUD_MAX_ERRORS) {
+          fallBack();
+        }
+        return false;
+      }
+      // Only errors in a row count, an odd one over hours doesn't.
+      m_errors = 0;
+
+      // Baud rate negotiation is handled here and never reaches the caller.
+      if (strncmp(input, "(BR)", 4) == 0) {
+        unsigned long requested = strtoul(input + 4, NULL, 10);
+        unsigned long accepted = constrain(requested, (unsigned long)SERIAL_BAUD_RATE, (unsigned long)SERIAL_MAX_BAUD_RATE);
+        char reply[16];
+        snprintf(reply, sizeof(reply), "(BA)%lu\n", accepted);
+        output(reply);
+
+        if (accepted != m_baudRate) {
+          switchBaudRate(accepted);
+          m_verifying = accepted != SERIAL_BAUD_RATE;
+        }
+        return false;
+      }
+
+      if (strncmp(input, "(BV)", 4) == 0) {
+        m_verifying = false;
+        // Echoed whole, however long the token is.
+        Serial.print(input);
+        Serial.print("\n");
+        return false;
+      }
+
+      return true;
+    }
+
+  private:
+    void switchBaudRate(unsigned long baud) {
+      // Make sure everything queued at the old rate is out before switching.
+      Serial.flush();
+      Serial.end();
+      Serial.begin(baud);
+      m_baudRate = baud;
+      m_switchTime = millis();
+      m_errors = 0;
+      m_verifying = false;
+    }
+
+    // Tell the driver at the current rate, then return to the safe rate.
+    void fallBack() {
+      char reply[16];
+      snprintf(reply, sizeof(reply), "(BA)%lu\n", (unsigned long)SERIAL_BAUD_RATE);
+      output(reply);
+      switchBaudRate(SERIAL_BAUD_RATE);
+    }
+
+    void checkVerification() {
+      if (m_verifying && millis() - m_switchTime > SERIAL_BAUD_VERIFY_TIMEOUT) {
+        // The driver never confirmed the new rate.
+        fallBack();
+      }
+    }
+
+    static bool isCorrupted(const char* input, size_t size) {
+      // The protocol is plain printable ASCII.
+      for (size_t i = 0; i < size; i++) {
+        unsigned char c = input[i];
+        if ((c < ' ' && c != '\r') || c > '~') return true;
+      }
+      return false;
     }
 };
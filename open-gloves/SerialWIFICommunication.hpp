@@ -3,19 +3,52 @@
 #include "Config.h"
 #include "ICommunication.hpp"
 #include <WiFi.h>
+#include <lwip/sockets.h>
 
 #define WIFI_READ_BUFFER_LEN 100
+
+// Serves one primary client and up to WIFI_MAX_SUBSCRIBERS read only subscribers.
+//
+// The first client to connect while there is no primary becomes the primary.
+// Only it may send commands (force feedback, haptics, settings...), anything the
+// subscribers send is discarded. Subscribers receive the same frames, so tools
+// can watch the live stream while the driver is connected.
+//
+// Each frame is copied once into a shared ring buffer and every subscriber sends
+// from its own position in that buffer without blocking. A subscriber that falls
+// more than WIFI_FANOUT_FRAMES frames behind skips ahead to the newest frame, so
+// a slow subscriber never stalls the primary's stream. If it was in the middle of
+// a frame, the partial line is ended with a newline first so the subscriber
+// resyncs at the next line. The skipped frames are counted in dropped.
 class WIFISerialCommunication : public ICommunication {
  private:
-  WiFiServer m_server{WIFI_SERIAL_PORT};
+  struct Subscriber {
+    WiFiClient client;
+    uint32_t frame = 0;   // The next frame to send.
+    uint16_t offset = 0;  // How much of that frame was already sent.
+    bool newline = false; // A cut off frame still needs its line ended.
+    uint32_t dropped = 0;
+  };
+
+  WiFiServer m_server;
   WiFiClient m_client;
+  Subscriber m_subscribers[WIFI_MAX_SUBSCRIBERS];
+
+  // Shared ring of frame data, positions are absolute and wrap.
+  char m_ring[WIFI_FANOUT_BUFFER_SIZE];
+  uint32_t m_head = 0;
+  uint32_t m_frame_starts[WIFI_FANOUT_FRAMES];
+  uint32_t m_frame_count = 0;
 
  public:
-  WIFISerialCommunication() {}
+  // A second hand on a dual hand board is served on its own port.
+  WIFISerialCommunication(uint16_t port = WIFI_SERIAL_PORT) : m_server(port) {}
 
   void start() {
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SERIAL_SSID, WIFI_SERIAL_PASSWORD);
+    if (WiFi.status() != WL_CONNECTED) {
+      WiFi.mode(WIFI_STA);
+      WiFi.begin(WIFI_SERIAL_SSID, WIFI_SERIAL_PASSWORD);
+    }
 
     if (WiFi.waitForConnectResult() != WL_CONNECTED) {
       Serial.printf("WiFI connection failed!\n");
@@ -29,10 +62,18 @@ class WIFISerialCommunication : public ICommunication {
   }
 
   bool isOpen() {
-    // Set the client.
-    m_client = m_server.available();
+    // Accept a waiting connection, if any.
+    WiFiClient incoming = m_server.available();
+    if (incoming) {
+      incoming.setNoDelay(true);
+      if (!(m_client && m_client.connected())) {
+        m_client = incoming;
+      } else {
+        addSubscriber(incoming);
+      }
+    }
 
-    // Check the status of the client.
+    // Check the status of the primary client.
     return m_client && m_client.connected();
   }
 
@@ -42,9 +83,28 @@ class WIFISerialCommunication : public ICommunication {
   }
 
   void output(char* data) {
+    size_t length = strlen(data);
+
     // Only call this if isOpen() returns true.
-    m_client.write(data);
+    m_client.write(data, length);
     m_client.flush();
+
+    // Frames that don't fit the ring are not fanned out.
+    if (length > WIFI_FANOUT_BUFFER_SIZE / 2) return;
+
+    appendFrame(data, length);
+    for (size_t i = 0; i < WIFI_MAX_SUBSCRIBERS; i++) {
+      Subscriber& subscriber = m_subscribers[i];
+      if (!subscriber.client) continue;
+      if (!subscriber.client.connected()) {
+        subscriber.client.stop();
+        continue;
+      }
+
+      // Subscribers are read only, throw away anything they send.
+      while (subscriber.client.available() > 0) subscriber.client.read();
+      pump(subscriber);
+    }
   }
 
   bool readData(char* input, size_t buffer_size) {
@@ -53,4 +113,95 @@ class WIFISerialCommunication : public ICommunication {
     input[size] = '\0';
     return size > 0;
   }
+
+  // Total frames skipped for slow subscribers.
+  uint32_t getDroppedFrames() const {
+    uint32_t dropped = 0;
+    for (size_t i = 0; i < WIFI_MAX_SUBSCRIBERS; i++) {
+      dropped += m_subscribers[i].dropped;
+    }
+    return dropped;
+  }
+
+ private:
+  void addSubscriber(WiFiClient& client) {
+    for (size_t i = 0; i < WIFI_MAX_SUBSCRIBERS; i++) {
+      Subscriber& subscriber = m_subscribers[i];
+      if (subscriber.client && subscriber.client.connected()) continue;
+
+      // Start with the next frame, so the subscriber never sees half a frame.
+      subscriber.client = client;
+      subscriber.frame = m_frame_count;
+      subscriber.offset = 0;
+      subscriber.newline = false;
+      return;
+    }
+
+    // No room left.
+    client.stop();
+  }
+
+  void appendFrame(const char* data, size_t length) {
+    m_frame_starts[m_frame_count % WIFI_FANOUT_FRAMES] = m_head;
+    m_frame_count++;
+
+    size_t start = m_head % WIFI_FANOUT_BUFFER_SIZE;
+    size_t first = min(length, (size_t)(WIFI_FANOUT_BUFFER_SIZE - start));
+    memcpy(m_ring + start, data, first);
+    memcpy(m_ring, data + first, length - first);
+    m_head += length;
+  }
+
+  uint32_t frameStart(uint32_t frame) const {
+    return m_frame_starts[frame % WIFI_FANOUT_FRAMES];
+  }
+
+  uint32_t frameEnd(uint32_t frame) const {
+    return frame + 1 == m_frame_count ? m_head : frameStart(frame + 1);
+  }
+
+  // Send as much as the subscriber's socket takes without blocking.
+  void pump(Subscriber& subscriber) {
+    while (subscriber.frame != m_frame_count) {
+      // The frame was overwritten, skip ahead to the newest frame. If part of
+      // it was already sent the rest is lost, that line is ended instead.
+      bool lost = m_frame_count - subscriber.frame > WIFI_FANOUT_FRAMES ||
+                  m_head - frameStart(subscriber.frame) > WIFI_FANOUT_BUFFER_SIZE;
+      if (lost) {
+        if (subscriber.offset != 0) {
+          subscriber.offset = 0;
+          subscriber.newline = true;
+        }
+        subscriber.dropped += m_frame_count - 1 - subscriber.frame;
+        subscriber.frame = m_frame_count - 1;
+      }
+
+      if (subscriber.newline) {
+        int sent = send(subscriber.client.fd(), "\n", 1, MSG_DONTWAIT);
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) subscriber.client.stop();
+        if (sent != 1) return;
+        subscriber.newline = false;
+      }
+
+      uint32_t position = frameStart(subscriber.frame) + subscriber.offset;
+      size_t remaining = frameEnd(subscriber.frame) - position;
+      size_t start = position % WIFI_FANOUT_BUFFER_SIZE;
+      size_t chunk = min(remaining, (size_t)(WIFI_FANOUT_BUFFER_SIZE - start));
+
+      int sent = send(subscriber.client.fd(), m_ring + start, chunk, MSG_DONTWAIT);
+      if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) subscriber.client.stop();
+        return;
+      }
+
+      if ((size_t)sent == remaining) {
+        subscriber.frame++;
+        subscriber.offset = 0;
+      } else {
+        subscriber.offset += sent;
+        // The socket is full, try again with the next frame.
+        if ((size_t)sent < chunk) return;
+      }
+    }
+  }
 };
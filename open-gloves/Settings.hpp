@@ -0,0 +1,301 @@
+#pragma once
+
+#include "Config.h"
+
+#include "Calibration.hpp"
+#include "ICommunication.hpp"
+
+#if ENABLE_RUNTIME_SETTINGS
+  #if defined(ESP32)
+    #include <Preferences.h>
+  #else
+    #include <EEPROM.h>
+  #endif
+#endif
+
+// Settings that can be tuned at runtime without reflashing. They start out with
+// the values from Config.h, and with ENABLE_RUNTIME_SETTINGS can be changed over
+// the communication channel and stored in NVS (ESP32) or EEPROM.
+//
+// The values live in a plain struct so reading one in the hot path is as cheap
+// as reading any other variable. Derived values are recalculated when a setting
+// changes instead of every sample.
+//
+// Commands from the driver channel:
+//   (PL)              list all settings
+//   (PG)<name>        get a setting
+//   (PS)<name>=<value> set a setting, it applies immediately
+//   (PW)              write the current settings to storage
+//   (PD)              restore the Config.h defaults (call (PW) to persist them)
+// Every get, set and list is answered with one line per setting:
+//   (PV)<name>=<value>\n
+//
+// The points captured for a curve calibration (See LookupTableCalibrator) are
+// stored with the settings, but aren't in the list.
+
+// Room for the curve points of every finger on every hand.
+#define CURL_POINT_SLOTS (HAND_COUNT * 5)
+constexpr int CURL_POINTS = CALIBRATION_CURL::POINTS > 0 ? CALIBRATION_CURL::POINTS : 1;
+
+struct SettingValues {
+  int32_t comm_delay;
+  int32_t joystick_deadzone; // Per mille of the joystick range.
+  int32_t invert_curl;
+  int32_t invert_splay;
+  int32_t invert_joy_x;
+  int32_t invert_joy_y;
+  int32_t median_filter;
+  int32_t calibration_loops;
+  int32_t ffb_min;
+  int32_t ffb_max;
+  int32_t ffb_release;
+  // Learned joystick calibration, a center of -1 is learned from the next sample.
+  int32_t joy_center_x;
+  int32_t joy_center_y;
+  int32_t joy_min_x;
+  int32_t joy_max_x;
+  int32_t joy_min_y;
+  int32_t joy_max_y;
+  // The second hand's joystick with ENABLE_DUAL_HAND.
+  int32_t joy2_center_x;
+  int32_t joy2_center_y;
+  int32_t joy2_min_x;
+  int32_t joy2_max_x;
+  int32_t joy2_min_y;
+  int32_t joy2_max_y;
+  // Raw curve calibration points of each finger, -1 if not captured.
+  int32_t curl_points[CURL_POINT_SLOTS][CURL_POINTS];
+
+  // Derived from the settings above, not stored.
+  int joystick_deadzone_raw;
+};
+
+class Settings {
+ public:
+  static void setup() {
+    restoreDefaults();
+    #if ENABLE_RUNTIME_SETTINGS
+      load();
+    #endif
+    apply();
+  }
+
+  // True once after a setting was changed.
+  static bool settingsChanged() {
+    bool result = changed;
+    changed = false;
+    return result;
+  }
+
+  // Handle settings commands. Returns true if the message was consumed.
+  static bool handle(ICommunication* comm, const char* input) {
+    #if ENABLE_RUNTIME_SETTINGS
+      if (strncmp(input, "(P", 2) != 0 || input[2] == '\0' || input[3] != ')') return false;
+
+      const char* argument = input + 4;
+      switch (input[2]) {
+        case 'L':
+          for (size_t i = 0; i < TABLE_SIZE; i++) {
+            send(comm, TABLE[i]);
+          }
+          break;
+        case 'G': {
+          const Entry* entry = find(argument, strlen(argument));
+          if (entry != NULL) send(comm, *entry);
+          break;
+        }
+        case 'S': {
+          const char* equals = strchr(argument, '=');
+          if (equals == NULL) break;
+          const Entry* entry = find(argument, equals - argument);
+          if (entry == NULL) break;
+          entry->field(current) = constrain(atol(equals + 1), entry->min, entry->max);
+          apply();
+          send(comm, *entry);
+          break;
+        }
+        case 'W':
+          save();
+          break;
+        case 'D':
+          restoreDefaults();
+          apply();
+          break;
+        default:
+          return false;
+      }
+      return true;
+    #else
+      return false;
+    #endif
+  }
+
+  // Write the current settings to storage, eg. after a calibration finished.
+  static void store() {
+    #if ENABLE_RUNTIME_SETTINGS
+      save();
+    #endif
+  }
+
+  static SettingValues current;
+
+ private:
+  struct Entry {
+    const char* name;
+    int32_t SettingValues::* member;
+    int32_t min;
+    int32_t max;
+
+    int32_t& field(SettingValues& values) const {
+      return values.*member;
+    }
+  };
+
+  static constexpr size_t TABLE_SIZE = ENABLE_DUAL_HAND ? 23 : 17;
+  static const Entry TABLE[TABLE_SIZE];
+  static constexpr uint32_t VERSION = 1;
+
+  static void restoreDefaults() {
+    current.comm_delay = COMM_DELAY;
+    current.joystick_deadzone = JOYSTICK_DEADZONE * 1000 + 0.5;
+    current.invert_curl = INVERT_CURL;
+    current.invert_splay = INVERT_SPLAY;
+    current.invert_joy_x = INVERT_JOY_X;
+    current.invert_joy_y = INVERT_JOY_Y;
+    current.median_filter = ENABLE_MEDIAN_FILTER;
+    current.calibration_loops = CALIBRATION_LOOPS;
+    current.ffb_min = FORCE_FEEDBACK_MIN;
+    current.ffb_max = FORCE_FEEDBACK_MAX;
+    current.ffb_release = FORCE_FEEDBACK_RELEASE;
+    current.joy_center_x = -1;
+    current.joy_center_y = -1;
+    current.joy_min_x = 0;
+    current.joy_max_x = ANALOG_MAX;
+    current.joy_min_y = 0;
+    current.joy_max_y = ANALOG_MAX;
+    current.joy2_center_x = -1;
+    current.joy2_center_y = -1;
+    current.joy2_min_x = 0;
+    current.joy2_max_x = ANALOG_MAX;
+    current.joy2_min_y = 0;
+    current.joy2_max_y = ANALOG_MAX;
+    for (int slot = 0; slot < CURL_POINT_SLOTS; slot++) {
+      for (int i = 0; i < CURL_POINTS; i++) {
+        current.curl_points[slot][i] = -1;
+      }
+    }
+  }
+
+  // Recalculate the derived values.
+  static void apply() {
+    current.joystick_deadzone_raw = (long)current.joystick_deadzone * ANALOG_MAX / 1000;
+    changed = true;
+  }
+
+  static const Entry* find(const char* name, size_t length) {
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+      if (strlen(TABLE[i].name) == length && strncmp(TABLE[i].name, name, length) == 0) {
+        return &TABLE[i];
+      }
+    }
+    return NULL;
+  }
+
+  static void send(ICommunication* comm, const Entry& entry) {
+    char message[48];
+    snprintf(message, sizeof(message), "(PV)%s=%ld\n", entry.name, (long)entry.field(current));
+    comm->output(message);
+  }
+
+  #if ENABLE_RUNTIME_SETTINGS
+    // The table entries are stored in table order after a version number, the
+    // curve points separately. A different version or table size means the
+    // stored settings are ignored.
+    static void load() {
+      int32_t stored[TABLE_SIZE + 1];
+      int32_t points[CURL_POINT_SLOTS][CURL_POINTS];
+      #if defined(ESP32)
+        Preferences preferences;
+        preferences.begin("opengloves", true);
+        size_t size = preferences.getBytes("settings", stored, sizeof(stored));
+        size_t points_size = preferences.getBytes("curl_points", points, sizeof(points));
+        preferences.end();
+        if (size != sizeof(stored)) return;
+      #else
+        EEPROM.get(SETTINGS_EEPROM_ADDRESS, stored);
+        EEPROM.get(SETTINGS_EEPROM_ADDRESS + sizeof(stored), points);
+        size_t points_size = sizeof(points);
+      #endif
+
+      if (stored[0] != (int32_t)(VERSION << 16 | TABLE_SIZE)) return;
+      for (size_t i = 0; i < TABLE_SIZE; i++) {
+        TABLE[i].field(current) = constrain(stored[i + 1], TABLE[i].min, TABLE[i].max);
+      }
+
+      // The points only match if the calibration has the same number of them.
+      if (CALIBRATION_CURL::POINTS == 0 || points_size != sizeof(points)) return;
+      for (int slot = 0; slot < CURL_POINT_SLOTS; slot++) {
+        for (int i = 0; i < CURL_POINTS; i++) {
+          current.curl_points[slot][i] = constrain(points[slot][i], -1, ANALOG_MAX);
+        }
+      }
+    }
+
+    static void save() {
+      int32_t stored[TABLE_SIZE + 1];
+      stored[0] = VERSION << 16 | TABLE_SIZE;
+      for (size_t i = 0; i < TABLE_SIZE; i++) {
+        stored[i + 1] = TABLE[i].field(current);
+      }
+      #if defined(ESP32)
+        Preferences preferences;
+        preferences.begin("opengloves", false);
+        preferences.putBytes("settings", stored, sizeof(stored));
+        if (CALIBRATION_CURL::POINTS > 0) {
+          preferences.putBytes("curl_points", current.curl_points, sizeof(current.curl_points));
+        }
+        preferences.end();
+      #else
+        EEPROM.put(SETTINGS_EEPROM_ADDRESS, stored);
+        if (CALIBRATION_CURL::POINTS > 0) {
+          EEPROM.put(SETTINGS_EEPROM_ADDRESS + sizeof(stored), current.curl_points);
+        }
+      #endif
+    }
+  #endif
+
+  static bool changed;
+};
+
+const Settings::Entry Settings::TABLE[Settings::TABLE_SIZE] = {
+  {"comm_delay",        &SettingValues::comm_delay,        1,    1000},
+  {"joystick_deadzone", &SettingValues::joystick_deadzone, 0,    1000},
+  {"invert_curl",       &SettingValues::invert_curl,       0,    1},
+  {"invert_splay",      &SettingValues::invert_splay,      0,    1},
+  {"invert_joy_x",      &SettingValues::invert_joy_x,      0,    1},
+  {"invert_joy_y",      &SettingValues::invert_joy_y,      0,    1},
+  {"median_filter",     &SettingValues::median_filter,     0,    ENABLE_MEDIAN_FILTER},
+  {"calibration_loops", &SettingValues::calibration_loops, -1,   INT32_MAX},
+  {"ffb_min",           &SettingValues::ffb_min,           0,    1000},
+  {"ffb_max",           &SettingValues::ffb_max,           0,    1000},
+  {"ffb_release",       &SettingValues::ffb_release,       0,    1000},
+  {"joy_center_x",      &SettingValues::joy_center_x,      -1,   ANALOG_MAX},
+  {"joy_center_y",      &SettingValues::joy_center_y,      -1,   ANALOG_MAX},
+  {"joy_min_x",         &SettingValues::joy_min_x,         0,    ANALOG_MAX},
+  {"joy_max_x",         &SettingValues::joy_max_x,         0,    ANALOG_MAX},
+  {"joy_min_y",         &SettingValues::joy_min_y,         0,    ANALOG_MAX},
+  {"joy_max_y",         &SettingValues::joy_max_y,         0,    ANALOG_MAX},
+  #if ENABLE_DUAL_HAND
+    {"joy2_center_x",     &SettingValues::joy2_center_x,     -1,   ANALOG_MAX},
+    {"joy2_center_y",     &SettingValues::joy2_center_y,     -1,   ANALOG_MAX},
+    {"joy2_min_x",        &SettingValues::joy2_min_x,        0,    ANALOG_MAX},
+    {"joy2_max_x",        &SettingValues::joy2_max_x,        0,    ANALOG_MAX},
+    {"joy2_min_y",        &SettingValues::joy2_min_y,        0,    ANALOG_MAX},
+    {"joy2_max_y",        &SettingValues::joy2_max_y,        0,    ANALOG_MAX},
+  #endif
+};
+SettingValues Settings::current;
+bool Settings::changed = false;
+
+// Short name for reading settings in the hot path.
+SettingValues& settings = Settings::current;
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Config.h"
+
+#include "DriverProtocol.hpp"
+#include "ICommunication.hpp"
+#include "LoopBudget.hpp"
+#include "PowerManager.hpp"
+
+// Link telemetry used to measure latency and loss between the glove and driver.
+//
+// Every frame gets a trailer with a wrapping sequence number and the time the
+// sample was taken, so the receiver can detect lost frames and measure how old
+// each sample is:
+//   A0123B0456...(Q)00042(U)0012345678\n
+//
+// The firmware also sends a ping with its clock every TELEMETRY_PING_INTERVAL ms.
+// The receiver echoes it back with its own clock, which gives the round trip time
+// and the offset between the two clocks:
+//   firmware: (P)0012345678\n
+//   receiver: (P)0012345678(PR)<receiver time us>\n
+//
+// Sending "(S)" requests the rolling statistics, which are answered with:
+//   (SR)<rtt us>(SJ)<jitter us>(SO)<clock offset us>(SL)<lost pings per mille>(SN)<frames sent>(SQ)<quality level>
+//   (SD)<duty cycle per mille>(SW)<wake latency us>(SX)<max wake latency us>(SU)<loop work us>
+//   (SP)<frame period us>\n
+// The quality level is the LoopBudget::Level currently active and the loop work
+// is its average time spent working per loop, the duty cycle and wake latencies
+// come from the PowerManager. The frame period is the average time between this
+// hand's frames.
+class LinkTelemetry {
+ public:
+  // (Q) + sequence + (U) + timestamp
+  static constexpr int TRAILER_SIZE = 3 + 5 + 3 + 10;
+
+  LinkTelemetry() : sequence(0), frames_sent(0), last_frame(0), frame_period(0), last_ping(0), ping_outstanding(false),
+                    pings_sent(0), pings_lost(0), rtt(0), jitter(0), offset(0) {}
+
+  // Replace the newline at the end of a frame with the trailer. The frame must
+  // have room for TRAILER_SIZE more characters. Returns the new length.
+  int appendTrailer(char* frame, int length, unsigned long sample_time) {
+    char* output = frame + length - 1;
+    memcpy(output, "(Q)", 3);
+    encodeDigits(output + 3, (unsigned long)sequence, 5);
+    memcpy(output + 8, "(U)", 3);
+    encodeDigits(output + 11, sample_time, 10);
+    output[TRAILER_SIZE] = '\n';
+    output[TRAILER_SIZE + 1] = '\0';
+
+    sequence = (sequence + 1) % 100000;
+    frames_sent++;
+    return length + TRAILER_SIZE;
+  }
+
+  // Send a ping if one is due. Call after every frame sent.
+  void update(ICommunication* comm) {
+    // Average over about 16 frames.
+    unsigned long sent = micros();
+    if (frames_sent > 1) frame_period += ((long)(sent - last_frame) - (long)frame_period) / 16;
+    last_frame = sent;
+
+    unsigned long now = millis();
+    if (now - last_ping < TELEMETRY_PING_INTERVAL) return;
+
+    // The last ping never came back.
+    if (ping_outstanding) pings_lost++;
+
+    char ping[3 + 10 + 2];
+    memcpy(ping, "(P)", 3);
+    encodeDigits(ping + 3, micros(), 10);
+    ping[13] = '\n';
+    ping[14] = '\0';
+    comm->output(ping);
+
+    last_ping = now;
+    ping_outstanding = true;
+    pings_sent++;
+  }
+
+  // Handle telemetry messages from the receiver. Returns true if the message
+  // was a telemetry message and should not be passed on to the outputs.
+  bool handle(ICommunication* comm, const char* input) {
+    if (strncmp(input, "(P)", 3) == 0) {
+      unsigned long now = micros();
+      unsigned long sent = strtoul(input + 3, NULL, 10);
+      const char* remote = strstr(input, "(PR)");
+      updateStatistics(now - sent, remote != NULL ? strtoul(remote + 4, NULL, 10) : 0, sent);
+      ping_outstanding = false;
+      return true;
+    }
+
+    if (strncmp(input, "(S)", 3) == 0) {
+      char report[190];
+      snprintf(report, sizeof(report), "(SR)%lu(SJ)%lu(SO)%ld(SL)%lu(SN)%lu(SQ)%d(SD)%lu(SW)%lu(SX)%lu(SU)%lu(SP)%lu\n",
+               rtt, jitter, offset,
+               pings_sent > 0 ? pings_lost * 1000 / pings_sent : 0UL, frames_sent,
+               LoopBudget::getLevel(), PowerManager::getDutyCycle(),
+               PowerManager::getWakeLatency(), PowerManager::getMaxWakeLatency(),
+               LoopBudget::getWorkTime(), frame_period);
+      comm->output(report);
+      return true;
+    }
+
+    return false;
+  }
+
+ private:
+  void updateStatistics(unsigned long sample_rtt, unsigned long remote_time, unsigned long sent) {
+    // Exponential moving averages with a weight of 1/8 for new samples.
+    if (rtt == 0) rtt = sample_rtt;
+    long difference = (long)sample_rtt - (long)rtt;
+    rtt += difference / 8;
+    jitter += ((long)abs(difference) - (long)jitter) / 8;
+
+    // Assume the receiver stamped the echo half way through the round trip.
+    if (remote_time != 0) {
+      offset = (long)(remote_time - (sent + sample_rtt / 2));
+    }
+  }
+
+  uint32_t sequence;
+  unsigned long frames_sent;
+  unsigned long last_frame;
+  unsigned long frame_period;
+  unsigned long last_ping;
+  bool ping_outstanding;
+  unsigned long pings_sent;
+  unsigned long pings_lost;
+  unsigned long rtt;
+  unsigned long jitter;
+  long offset;
+};
@@ -1,6 +1,8 @@
 #include "Config.h"
 #include "HardwareConfig.hpp"
 #include "ICommunication.hpp"
+#include "Glove.hpp"
+#include "PowerManager.hpp"
 
 #if COMMUNICATION == COMM_USB
   #include "SerialCommunication.hpp"
@@ -11,77 +13,117 @@
 #elif COMMUNICATION == COMM_WIFI
   #include "SerialWIFICommunication.hpp"
   ICommunication* comm = new WIFISerialCommunication();
+#elif COMMUNICATION == COMM_ESPNOW
+  #include "ESPNowCommunication.hpp"
+  #if ENABLE_DUAL_HAND
+    ICommunication* comm = new ESPNowCommunication(ESPNOW_HAND_LEFT);
+  #else
+    ICommunication* comm = new ESPNowCommunication();
+  #endif
 #endif
 
-#define ALWAYS_CALIBRATING CALIBRATION_LOOPS == -1
-int calibration_count = 0;
-
-// These are composite lists of the hardware defined in the header above.
-EncodedInput* inputs[MAX_INPUT_COUNT];
-DecodedOuput* outputs[MAX_OUTPUT_COUNT];
-Calibrated* calibrators[MAX_CALIBRATED_COUNT];
+// The channels each hand is sent on.
+#if !ENABLE_DUAL_HAND
+  ICommunication* comms[HAND_COUNT] = {comm};
+#elif DUAL_HAND_STREAMS == DUAL_HAND_MULTIPLEXED
+  #include "HandMultiplexer.hpp"
+  HandMultiplexer multiplexer(comm, Glove::handleGlobal);
+  ICommunication* comms[HAND_COUNT] = {multiplexer.channel(0), multiplexer.channel(1)};
+#elif COMMUNICATION == COMM_WIFI
+  ICommunication* comms[HAND_COUNT] = {comm, new WIFISerialCommunication(WIFI_SERIAL_PORT_2)};
+#elif COMMUNICATION == COMM_ESPNOW
+  ICommunication* comms[HAND_COUNT] = {comm, new ESPNowCommunication(ESPNOW_HAND_RIGHT)};
+#else
+  #error "DUAL_HAND_SEPARATE needs COMM_WIFI or COMM_ESPNOW, use DUAL_HAND_MULTIPLEXED instead."
+#endif
 
-char* encoded_output_string;
-size_t input_count = 0;
-size_t output_count = 0;
-size_t calibrated_count = 0;
+Glove gloves[HAND_COUNT] = {
+  Glove(comms[0], &calibration_button, MAX_INPUT_COUNT + CUSTOM_GESTURE_COUNT),
+  #if ENABLE_DUAL_HAND
+    Glove(comms[1], &calibration_button_2, MAX_INPUT_COUNT + CUSTOM_GESTURE_COUNT_2),
+  #endif
+};
 
-// Common pattern for registering inputs and outputs
-#define register(source, destination, new_count, existing) \
-do {                                                       \
-  for (size_t i = 0; i < new_count; existing++, i++) {     \
-    destination[existing] = source[i];                     \
-  }                                                        \
-} while(false)
+#if ENABLE_BATCHING
+  unsigned long next_sample_time = 0;
+#endif
 
 void setup() {
-  // First thing to do is open the the communication channel.
-  comm->start();
+  // Load the settings before anything uses them.
+  Settings::setup();
+
+  // First thing to do is open the the communication channels.
+  for (size_t i = 0; i < HAND_COUNT; i++) {
+    comms[i]->start();
+  }
 
   // Register the inputs.
-  register(buttons, inputs, BUTTON_COUNT, input_count);
-  register(fingers, inputs, FINGER_COUNT, input_count);
-  register(joysticks, inputs, JOYSTICK_COUNT, input_count);
-  register(gestures, inputs, GESTURE_COUNT, input_count);
+  gloves[0].addInputs(buttons, BUTTON_COUNT);
+  gloves[0].addInputs(fingers, FINGER_COUNT);
+  gloves[0].addInputs(joysticks, JOYSTICK_COUNT);
+  gloves[0].addInputs(imus, IMU_COUNT);
+  gloves[0].addInputs(gestures, GESTURE_COUNT);
+  gloves[0].addInputs(custom_gestures, CUSTOM_GESTURE_COUNT);
 
   // Register the calibrated inputs
-  register(fingers, calibrators, FINGER_COUNT, calibrated_count);
+  gloves[0].addCalibrated(fingers, FINGER_COUNT);
+  gloves[0].addCalibrated(sticks, STICK_COUNT);
 
   // Register the outputs.
-  register(force_feedbacks, outputs, FORCE_FEEDBACK_COUNT, output_count);
-  register(haptics, outputs, HAPTIC_COUNT, output_count);
-
-  // Figure out needed size for the output string.
-  int string_size = 0;
-  for(size_t i = 0; i < input_count; i++) {
-    string_size += inputs[i]->getEncodedSize();
-  }
-
-  // Add 1 for new line and 1 for the null terminator.
-  encoded_output_string = new char[string_size + 1 + 1];
-
-  // Setup all the inputs.
-  for (size_t i = 0; i < input_count; i++) {
-    inputs[i]->setupInput();
-  }
-
-  // Setup all the outputs.
-  for (size_t i = 0; i < output_count; i++) {
-    outputs[i]->setupOutput();
+  gloves[0].addOutputs(force_feedbacks, FORCE_FEEDBACK_COUNT);
+  gloves[0].addOutputs(haptics, HAPTIC_COUNT);
+
+  // The second hand is registered the same way.
+  #if ENABLE_DUAL_HAND
+    gloves[1].addInputs(buttons_2, BUTTON_COUNT);
+    gloves[1].addInputs(fingers_2, FINGER_COUNT);
+    gloves[1].addInputs(joysticks_2, JOYSTICK_COUNT);
+    gloves[1].addInputs(imus_2, IMU_COUNT);
+    gloves[1].addInputs(gestures_2, GESTURE_COUNT);
+    gloves[1].addInputs(custom_gestures_2, CUSTOM_GESTURE_COUNT_2);
+    gloves[1].addCalibrated(fingers_2, FINGER_COUNT);
+    gloves[1].addCalibrated(sticks_2, STICK_COUNT);
+    gloves[1].addOutputs(force_feedbacks_2, FORCE_FEEDBACK_COUNT);
+    gloves[1].addOutputs(haptics_2, HAPTIC_COUNT);
+  #endif
+
+  // Build the ADC correction and start the external ADC before any analog inputs are read.
+  AnalogSource::setup();
+  SampleTrace::setup();
+
+  // Setup all the inputs and outputs.
+  for (size_t i = 0; i < HAND_COUNT; i++) {
+    gloves[i].setup();
   }
 
   // Setup the StatusLED.
   led.setup();
 
-  if (ALWAYS_CALIBRATING) {
-    for (size_t i = 0; i < calibrated_count; i++) {
-      calibrators[i]->enableCalibration();
+  // Any button wakes the glove when it is sleeping between frames.
+  #if ENABLE_POWER_SAVING
+    for (size_t i = 0; i < BUTTON_COUNT; i++) {
+      PowerManager::addWakePin(buttons[i]->getPin());
     }
-  }
+    #if ENABLE_DUAL_HAND
+      for (size_t i = 0; i < BUTTON_COUNT; i++) {
+        PowerManager::addWakePin(buttons_2[i]->getPin());
+      }
+    #endif
+  #endif
+  PowerManager::setup();
 }
 
 void loop() {
-  if (!comm->isOpen()){
+  LoopBudget::beginLoop();
+
+  bool settings_changed = Settings::settingsChanged();
+  bool all_open = true;
+  for (size_t i = 0; i < HAND_COUNT; i++) {
+    gloves[i].update(settings_changed);
+    all_open = all_open && gloves[i].isOpen();
+  }
+
+  if (!all_open){
     // Connection to Driver not ready, blink the LED to indicate no connection.
     led.setState(StatusLED::State::BLINK_STEADY);
   } else {
@@ -89,49 +131,68 @@ void loop() {
     led.setState(StatusLED::State::ON);
   }
 
-  // Notify the calibrators to turn on.
-  if (calibration_button.isPressed()) {
-    calibration_count = 0;
-    for (size_t i = 0; i < calibrated_count; i++) {
-      calibrators[i]->resetCalibration();
-      calibrators[i]->enableCalibration();
-    }
+  // Update all the inputs, both hands in the same pass.
+  unsigned long sample_time = micros();
+  #if ENABLE_RECORDING
+    SampleTrace::beginFrame(sample_time);
+  #endif
+  // Read the external ADC in one burst, replays don't touch the hardware.
+  if (SampleTrace::getMode() != SampleTrace::REPLAYING) {
+    AnalogSource::sample();
+  }
+  for (size_t i = 0; i < HAND_COUNT; i++) {
+    gloves[i].readInputs();
   }
+  #if ENABLE_RECORDING
+    SampleTrace::endFrame(comms[0]);
+  #endif
 
-  if (calibration_count < CALIBRATION_LOOPS || ALWAYS_CALIBRATING) {
-    // Keep calibrating for one at least one more loop.
-    calibration_count++;
-  } else {
-    // Calibration is done, notify the calibrators
-    for (size_t i = 0; i < calibrated_count; i++) {
-      calibrators[i]->disableCalibration();
-    }
+  for (size_t i = 0; i < HAND_COUNT; i++) {
+    gloves[i].sendFrame(sample_time);
   }
 
-  // Update all the inputs
-  for (int i = 0; i < input_count; i++) {
-    inputs[i]->readInput();
+  for (size_t i = 0; i < HAND_COUNT; i++) {
+    gloves[i].updateOutputs();
   }
 
-  // Encode all of the inputs to a single string.
-  encodeAll(encoded_output_string, inputs, input_count);
+  LoopBudget::endLoop();
 
-  // Send the string to the communication handler.
-  comm->output(encoded_output_string);
+  #if ENABLE_RECORDING
+    // Write the recording once the frames are out.
+    SampleTrace::flush();
+  #endif
 
-  char received_bytes[100];
-  if ((ENABLE_SYNCHRONOUS_COMM || comm->hasData()) &&
-      comm->readData(received_bytes, 100)) {
-    for (size_t i = 0; i < output_count; i++) {
-      // Decode the update and write it to the output.
-      outputs[i]->decodeToOuput(received_bytes);
-    }
+  // Both hands run on the schedule of the one that needs the fastest loop.
+  int period = gloves[0].getHandshake().getPeriod();
+  for (size_t i = 1; i < HAND_COUNT; i++) {
+    period = min(period, gloves[i].getHandshake().getPeriod());
   }
 
-  // Allow all the outputs to update their state.
-  for (size_t i = 0; i < output_count; i++) {
-    outputs[i]->updateOutput();
-  }
+  #if ENABLE_BATCHING
+    bool batched = false;
+    for (size_t i = 0; i < HAND_COUNT; i++) {
+      batched = batched || gloves[i].getHandshake().uses(Handshake::BATCHED);
+    }
+    if (batched) {
+      // Sample on a fixed schedule, catching up if sending ran late.
+      next_sample_time += BATCH_SAMPLE_PERIOD;
+      #if ENABLE_POWER_SAVING
+        if (!PowerManager::sleepUntil(next_sample_time)) {
+          next_sample_time = micros();
+        }
+      #else
+        long remaining = (long)(next_sample_time - micros());
+        if (remaining > 0) {
+          delayMicroseconds(remaining);
+        } else {
+          next_sample_time = micros();
+        }
+      #endif
+      return;
+    }
+  #endif
 
-  delay(COMM_DELAY);
+  // Frames go out on a deadline every period no matter how long the work took,
+  // so a second hand doesn't slow the frames down.
+  PowerManager::sleep(period * 1000UL);
 }